@@ -0,0 +1,225 @@
+#include "activity.h"
+#include "pool.h"
+#include "rule.h"
+#include "neighborhood.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void *malloc_tracking(size_t size) {
+    void *data = malloc(size);
+    if (!data) {
+        fprintf(stderr, "Memory allocation failed for activity tracking!\n");
+        exit(1);
+    }
+    return data;
+}
+
+// Start tracking changed tiles; the first generation recomputes everything
+void enable_activity_tracking(struct grid *grid) {
+    if (grid->activity) return;
+
+    struct activity *activity = malloc_tracking(sizeof(struct activity));
+    activity->tiles_x = (grid->width >> 6) + 1;     // Padded column width lands in the last tile
+    activity->tiles_y = (grid->height + TILE_SIZE - 1) / TILE_SIZE;
+    int tiles = activity->tiles_x * activity->tiles_y;
+    activity->changed = malloc_tracking(tiles);
+    activity->next_changed = malloc_tracking(tiles);
+    activity->active = malloc_tracking(tiles * sizeof(int));
+    activity->by_column = malloc_tracking(tiles * sizeof(int));
+    activity->changed_list = malloc_tracking(tiles * sizeof(int));
+    activity->active_count = 0;
+
+    grid->activity = activity;
+    mark_all_changed(grid);
+}
+
+void disable_activity_tracking(struct grid *grid) {
+    struct activity *activity = grid->activity;
+    if (!activity) return;
+
+    free(activity->changed);
+    free(activity->next_changed);
+    free(activity->active);
+    free(activity->by_column);
+    free(activity->changed_list);
+    free(activity);
+    grid->activity = NULL;
+}
+
+// Treat every tile as changed, after the cells were modified outside of
+// step_active_tiles or the next buffer no longer holds the previous generation
+void mark_all_changed(struct grid *grid) {
+    struct activity *activity = grid->activity;
+    if (!activity) return;
+
+    int tiles = activity->tiles_x * activity->tiles_y;
+    memset(activity->changed, 1, tiles);
+    for (int i = 0; i < tiles; i++) {
+        activity->changed_list[i] = i;
+    }
+    activity->changed_count = tiles;
+}
+
+// Whether tile (tx, ty) changed in the last generation
+int tile_changed(const struct grid *grid, int tx, int ty) {
+    const struct activity *activity = grid->activity;
+    if (!activity) return 1;
+    return activity->changed[ty * activity->tiles_x + tx];
+}
+
+// Indices (ty * tiles_x + tx) of the tiles that changed in the last generation
+const int *changed_tiles(const struct grid *grid, int *count) {
+    *count = grid->activity->changed_count;
+    return grid->activity->changed_list;
+}
+
+// Cells [x0, x1) x [y0, y1) covered by a tile
+void tile_bounds(const struct grid *grid, int tile, int *x0, int *x1, int *y0, int *y1) {
+    int tx = tile % grid->activity->tiles_x;
+    int ty = tile / grid->activity->tiles_x;
+    *x0 = (tx == 0) ? 0 : tx * TILE_SIZE - 1;
+    *x1 = (tx * TILE_SIZE + TILE_SIZE - 1 < grid->width) ? tx * TILE_SIZE + TILE_SIZE - 1 : grid->width;
+    *y0 = ty * TILE_SIZE;
+    *y1 = (*y0 + TILE_SIZE < grid->height) ? *y0 + TILE_SIZE : grid->height;
+}
+
+// Tiles along one axis holding cells within reach of cells [c0, c1), as
+// count tiles from first on; cell c lies in tile (c + offset) / TILE_SIZE.
+// On a torus they wrap, and since the last tile is usually narrower than the
+// others, a reach past one cell can jump over it to the tile before.
+static int tiles_in_reach(int c0, int c1, int reach, int cells, int tiles, int offset, int torus, int *first) {
+    int lo = c0 - reach, hi = c1 - 1 + reach;
+    if (torus) {
+        if (hi - lo + 1 >= cells) {
+            *first = 0;
+            return tiles;
+        }
+        lo = ((lo % cells) + cells) % cells;
+        hi = ((hi % cells) + cells) % cells;
+    } else {
+        lo = (lo < 0) ? 0 : lo;
+        hi = (hi >= cells) ? cells - 1 : hi;
+    }
+    *first = (lo + offset) / TILE_SIZE;
+    int last = (hi + offset) / TILE_SIZE;
+    int count = (lo <= hi) ? last - *first + 1 : tiles - *first + last + 1;
+    return (count < tiles) ? count : tiles;
+}
+
+// Whether any tile within reach cells of tile (tx, ty) changed, itself included.
+// Past an edge other than a torus there is nothing that could change.
+static int neighborhood_changed(const struct grid *grid, int tx, int ty, int reach) {
+    const struct activity *activity = grid->activity;
+    int torus = (grid->boundary == BOUNDARY_TORUS);
+    int x0, x1, y0, y1, first_x, first_y;
+    tile_bounds(grid, ty * activity->tiles_x + tx, &x0, &x1, &y0, &y1);
+    int count_x = tiles_in_reach(x0, x1, reach, grid->width, activity->tiles_x, 1, torus, &first_x);
+    int count_y = tiles_in_reach(y0, y1, reach, grid->height, activity->tiles_y, 0, torus, &first_y);
+
+    for (int j = 0; j < count_y; j++) {
+        int y = (first_y + j) % activity->tiles_y;
+        for (int i = 0; i < count_x; i++) {
+            int x = (first_x + i) % activity->tiles_x;
+            if (activity->changed[y * activity->tiles_x + x]) return 1;
+        }
+    }
+    return 0;
+}
+
+struct tile_job {
+    struct grid *grid;
+    const struct rule *rule;
+    step_kernel kernel;
+    const uint8_t *cells;
+    uint8_t *next;
+    struct neighborhood_window *windows;
+};
+
+static void step_tiles(void *arg, int thread, int threads) {
+    struct tile_job *job = arg;
+    struct activity *activity = job->grid->activity;
+
+    if (job->windows) {
+        // A run of the columns each, so the window slides from a tile to the one below
+        int first = (int)((long long)activity->active_count * thread / threads);
+        int last = (int)((long long)activity->active_count * (thread + 1) / threads);
+        for (int i = first; i < last; i++) {
+            int tile = activity->by_column[i];
+            int x0, x1, y0, y1;
+            tile_bounds(job->grid, tile, &x0, &x1, &y0, &y1);
+            activity->next_changed[tile] = (uint8_t)step_neighborhood_window(&job->windows[thread], job->grid,
+                                                                            job->rule, job->cells, job->next,
+                                                                            x0, x1, y0, y1);
+        }
+        return;
+    }
+    for (int i = thread; i < activity->active_count; i += threads) {
+        int tile = activity->active[i];
+        int x0, x1, y0, y1;
+        tile_bounds(job->grid, tile, &x0, &x1, &y0, &y1);
+        activity->next_changed[tile] = (uint8_t)job->kernel(job->grid, job->rule, job->cells, job->next, x0, x1, y0, y1);
+    }
+}
+
+// Sort the active tiles by column into by_column, keeping each column top to bottom
+static void sort_by_column(struct activity *activity) {
+    int *starts = calloc((size_t)activity->tiles_x + 1, sizeof(int));
+    if (!starts) {
+        fprintf(stderr, "Memory allocation failed for activity tracking!\n");
+        exit(1);
+    }
+    for (int i = 0; i < activity->active_count; i++) {
+        starts[activity->active[i] % activity->tiles_x + 1]++;
+    }
+    for (int tx = 0; tx < activity->tiles_x; tx++) {
+        starts[tx + 1] += starts[tx];
+    }
+    for (int i = 0; i < activity->active_count; i++) {
+        int tile = activity->active[i];
+        activity->by_column[starts[tile % activity->tiles_x]++] = tile;
+    }
+    free(starts);
+}
+
+// Step only the tiles whose neighborhood changed in the last generation and
+// record which of them change now. The halo of the current buffer must be up
+// to date; the caller swaps the buffers afterwards. Given windows, one per
+// thread of the pool, the neighborhood kernel is used in place of kernel.
+void step_active_tiles(struct grid *grid, const struct rule *rule, step_kernel kernel,
+                       struct neighborhood_window *windows) {
+    struct activity *activity = grid->activity;
+    int tiles = activity->tiles_x * activity->tiles_y;
+
+    int reach = rule_reach(rule);
+    activity->active_count = 0;
+    for (int ty = 0; ty < activity->tiles_y; ty++) {
+        for (int tx = 0; tx < activity->tiles_x; tx++) {
+            if (neighborhood_changed(grid, tx, ty, reach)) {
+                activity->active[activity->active_count++] = ty * activity->tiles_x + tx;
+            }
+        }
+    }
+    memset(activity->next_changed, 0, tiles);
+    if (windows) {
+        sort_by_column(activity);
+    }
+
+    struct tile_job job = {grid, rule, kernel, current_cells(grid), next_cells(grid), windows};
+    if (grid->pool && grid->pool->threads > 1) {
+        run_on_pool(grid->pool, step_tiles, &job);
+    } else {
+        step_tiles(&job, 0, 1);
+    }
+
+    uint8_t *swap = activity->changed;
+    activity->changed = activity->next_changed;
+    activity->next_changed = swap;
+
+    activity->changed_count = 0;
+    for (int i = 0; i < activity->active_count; i++) {
+        if (activity->changed[activity->active[i]]) {
+            activity->changed_list[activity->changed_count++] = activity->active[i];
+        }
+    }
+}
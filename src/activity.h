@@ -0,0 +1,39 @@
+#ifndef ACTIVITY_H
+#define ACTIVITY_H
+
+#include "grid.h"
+#include "kernel.h"
+
+#define TILE_SIZE 64    // Cells per tile side, one word of a bit grid
+
+// Per-tile change tracking. Tiles are TILE_SIZE x TILE_SIZE cells laid out on
+// padded columns, so on bit grids every tile column is exactly one word.
+// A tile is only recomputed when a tile within the rule's reach of it, which
+// for the 3x3 rules means one of its 8 neighbors, changed in the previous
+// generation; every other tile is already correct in the next buffer, which
+// still holds the generation before.
+struct activity {
+    int tiles_x;
+    int tiles_y;
+    uint8_t *changed;       // Tiles that changed in the last generation
+    uint8_t *next_changed;
+    int *active;            // Tiles to recompute in the coming generation
+    int active_count;
+    int *by_column;         // The active tiles again, column by column, for windowed kernels
+    int *changed_list;      // The changed tiles again, as a list of indices
+    int changed_count;
+};
+
+void enable_activity_tracking(struct grid *grid);
+void disable_activity_tracking(struct grid *grid);
+void mark_all_changed(struct grid *grid);
+
+int tile_changed(const struct grid *grid, int tx, int ty);
+const int *changed_tiles(const struct grid *grid, int *count);
+void tile_bounds(const struct grid *grid, int tile, int *x0, int *x1, int *y0, int *y1);
+
+struct neighborhood_window;
+void step_active_tiles(struct grid *grid, const struct rule *rule, step_kernel kernel,
+                       struct neighborhood_window *windows);
+
+#endif
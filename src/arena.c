@@ -0,0 +1,171 @@
+#include "arena.h"
+#include "grid.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+struct kept_block {
+    uint8_t *block;
+    size_t size;                // Rounded as when it was handed out
+};
+
+// Shared by every thread; blocks change hands rarely enough for one lock
+static struct {
+    pthread_mutex_t lock;
+    struct kept_block kept[ARENA_KEPT_BLOCKS];
+    int kept_count;
+    struct memory_stats stats;
+} arena = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static size_t rounded_size(size_t size) {
+    if (size >= ARENA_MAP_BYTES) {
+        return (size + ARENA_MAP_BYTES - 1) & ~(ARENA_MAP_BYTES - 1);
+    }
+    return (size + GRID_ALIGNMENT - 1) & ~(size_t)(GRID_ALIGNMENT - 1);
+}
+
+// Map a block aligned to a huge page, trimming the slack on either side.
+// Its pages stay unbacked, and zero, until first written.
+static uint8_t *map_block(size_t size) {
+    size_t span = size + ARENA_MAP_BYTES;
+    uint8_t *mapping = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Memory allocation failed for grid!\n");
+        exit(1);
+    }
+    uint8_t *block = (uint8_t *)(((uintptr_t)mapping + ARENA_MAP_BYTES - 1) & ~(uintptr_t)(ARENA_MAP_BYTES - 1));
+    size_t head = (size_t)(block - mapping);
+    if (head > 0) {
+        munmap(mapping, head);
+    }
+    if (span - head - size > 0) {
+        munmap(block + size, span - head - size);
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(block, size, MADV_HUGEPAGE);   // Only advice; without THP the block keeps small pages
+#endif
+    return block;
+}
+
+static uint8_t *heap_block(size_t size) {
+    void *block = NULL;
+    if (posix_memalign(&block, GRID_ALIGNMENT, size) != 0) {
+        fprintf(stderr, "Memory allocation failed for grid!\n");
+        exit(1);
+    }
+    memset(block, 0, size);
+    return block;
+}
+
+static void release_block(uint8_t *block, size_t size) {
+    if (size >= ARENA_MAP_BYTES) {
+        munmap(block, size);
+    } else {
+        free(block);
+    }
+}
+
+// Drop kept block i, keeping the rest oldest first. Called with the lock held.
+static void remove_kept_block(int i) {
+    arena.stats.kept_bytes -= arena.kept[i].size;
+    memmove(&arena.kept[i], &arena.kept[i + 1], (size_t)(arena.kept_count - i - 1) * sizeof(struct kept_block));
+    arena.kept_count--;
+}
+
+// A zeroed, cache-line-aligned block of at least size bytes
+uint8_t *arena_alloc(size_t size) {
+    size = rounded_size(size);
+    uint8_t *block = NULL;
+
+    pthread_mutex_lock(&arena.lock);
+    for (int i = arena.kept_count - 1; i >= 0; i--) {
+        if (arena.kept[i].size == size) {
+            block = arena.kept[i].block;
+            remove_kept_block(i);
+            arena.stats.reused++;
+            break;
+        }
+    }
+    arena.stats.blocks++;
+    arena.stats.huge_blocks += (size >= ARENA_MAP_BYTES);
+    arena.stats.live_bytes += size;
+    if (arena.stats.live_bytes > arena.stats.peak_bytes) {
+        arena.stats.peak_bytes = arena.stats.live_bytes;
+    }
+    pthread_mutex_unlock(&arena.lock);
+
+    if (block) {
+        // Its pages were placed when it was first used, clearing them keeps them there
+        memset(block, 0, size);
+        return block;
+    }
+    return (size >= ARENA_MAP_BYTES) ? map_block(size) : heap_block(size);
+}
+
+// Give back a block from arena_alloc, size being what was asked for then.
+// It is kept for reuse, making room by releasing the oldest kept blocks; a
+// block larger than ARENA_KEPT_BYTES on its own is released straight away.
+void arena_free(uint8_t *block, size_t size) {
+    if (!block) return;
+    size = rounded_size(size);
+
+    struct kept_block evicted[ARENA_KEPT_BLOCKS];
+    int evicted_count = 0;
+    pthread_mutex_lock(&arena.lock);
+    arena.stats.live_bytes -= size;
+    int kept = size <= ARENA_KEPT_BYTES;
+    if (kept) {
+        while (arena.kept_count == ARENA_KEPT_BLOCKS || arena.stats.kept_bytes + size > ARENA_KEPT_BYTES) {
+            evicted[evicted_count++] = arena.kept[0];
+            remove_kept_block(0);
+        }
+        arena.kept[arena.kept_count++] = (struct kept_block){block, size};
+        arena.stats.kept_bytes += size;
+    }
+    pthread_mutex_unlock(&arena.lock);
+
+    // Unmapping can take a while, so it happens outside the lock
+    for (int i = 0; i < evicted_count; i++) {
+        release_block(evicted[i].block, evicted[i].size);
+    }
+    if (!kept) {
+        release_block(block, size);
+    }
+}
+
+// Return every kept block to the system
+void release_kept_blocks(void) {
+    pthread_mutex_lock(&arena.lock);
+    for (int i = 0; i < arena.kept_count; i++) {
+        release_block(arena.kept[i].block, arena.kept[i].size);
+    }
+    arena.kept_count = 0;
+    arena.stats.kept_bytes = 0;
+    pthread_mutex_unlock(&arena.lock);
+}
+
+void get_memory_stats(struct memory_stats *stats) {
+    pthread_mutex_lock(&arena.lock);
+    *stats = arena.stats;
+    pthread_mutex_unlock(&arena.lock);
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        stats->peak_rss_kb = usage.ru_maxrss;
+        stats->minor_faults = usage.ru_minflt;
+        stats->major_faults = usage.ru_majflt;
+    }
+}
+
+void print_memory_stats(FILE *file) {
+    struct memory_stats stats;
+    get_memory_stats(&stats);
+    fprintf(file, "Cell memory: %.1f MiB peak, %.1f MiB live, %.1f MiB kept; %llu blocks, %llu reused, %llu on huge pages\n",
+            stats.peak_bytes / 1048576.0, stats.live_bytes / 1048576.0, stats.kept_bytes / 1048576.0,
+            (unsigned long long)stats.blocks, (unsigned long long)stats.reused,
+            (unsigned long long)stats.huge_blocks);
+    fprintf(file, "Process: %.1f MiB peak resident, %ld minor and %ld major page faults\n",
+            stats.peak_rss_kb / 1024.0, stats.minor_faults, stats.major_faults);
+}
@@ -0,0 +1,42 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Cell memory for grids, snapshots and scratch tiles. Every block is zeroed
+// and starts on a cache line. Blocks of ARENA_MAP_BYTES or more are mapped on
+// their own, aligned for and advised onto transparent huge pages, and left
+// untouched so that the first thread to write a page places it: the pool
+// fills and steps a grid in the same bands of rows, so each band's pages end
+// up on the node of the thread that steps it. Freed blocks are kept for the
+// next block of the same size, so grids created and destroyed over and over,
+// as in sweeps and resizing, stop going back to the system. When the kept
+// blocks run out of slots or bytes the oldest go back first, so a resize
+// that never returns to a size cannot pile up blocks nothing will take.
+
+#define ARENA_MAP_BYTES ((size_t)2 << 20)      // A huge page; smaller blocks come from the heap
+#define ARENA_KEPT_BLOCKS 16                    // Freed blocks kept for reuse
+#define ARENA_KEPT_BYTES ((size_t)256 << 20)   // Most memory the kept blocks may hold
+
+struct memory_stats {
+    size_t live_bytes;          // In blocks handed out and not yet freed
+    size_t peak_bytes;          // Highest live_bytes so far
+    size_t kept_bytes;          // In freed blocks kept for reuse
+    uint64_t blocks;            // Handed out so far
+    uint64_t reused;            // Of those, taken from the kept blocks
+    uint64_t huge_blocks;       // Of those, mapped and advised onto huge pages
+    long peak_rss_kb;           // Of the whole process, from getrusage
+    long minor_faults;
+    long major_faults;
+};
+
+uint8_t *arena_alloc(size_t size);
+void arena_free(uint8_t *block, size_t size);
+void release_kept_blocks(void);
+
+void get_memory_stats(struct memory_stats *stats);
+void print_memory_stats(FILE *file);
+
+#endif
@@ -0,0 +1,764 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+#include "grid.h"
+#include "kernel.h"
+#include "rule.h"
+#include "pool.h"
+#include "activity.h"
+#include "hashlife.h"
+#include "world.h"
+#include "ensemble.h"
+#include "render.h"
+#include "checkpoint.h"
+#include "arena.h"
+#include "stats.h"
+#include "neighborhood.h"
+
+// Timings of each way of stepping, storing and drawing a grid, one table per
+// section, against the plain way of doing the same thing. Every section
+// notes a MISMATCH when the two disagree; make test checks the same paths
+// thoroughly on small grids without a window. The first argument caps the
+// threads, by default the CPUs.
+
+int generations = 50;
+unsigned int seed = 42;
+int scaling_size = 2000;
+int blocking_size = 4096;
+int activity_size = 2048;
+int render_size = 400;
+int ensemble_members = 512;
+int ensemble_size = 64;
+int lifetimes = 10;
+int neighborhood_size = 400;
+int neighborhood_generations = 5;
+int matrix_sizes[] = {256, 1024, 4096};
+int matrix_cyclic_states[] = {2, 4, 8, 16};
+long matrix_work = 100000000;   // Cell updates per matrix entry, at least 10 generations
+
+struct bench_rule {
+    const char *name;
+    int (*rule_function)(int, int, const uint8_t *, struct grid *);
+    int states;
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Check that two grids hold the same current generation
+static int grids_equal(struct grid *a, struct grid *b) {
+    for (int y = 0; y < a->height; y++) {
+        for (int x = 0; x < a->width; x++) {
+            if (get_cell(a, current_cells(a), x, y) != get_cell(b, current_cells(b), x, y)) return 0;
+        }
+    }
+    return 1;
+}
+
+// Step a grid a number of generations and return the elapsed seconds
+static double time_generations(struct grid *grid, struct bench_rule *rule, int per_cell) {
+    double start = now_seconds();
+    for (int i = 0; i < generations; i++) {
+        if (per_cell) {
+            update_grid_per_cell(grid, rule->rule_function);
+        } else {
+            update_grid(grid, rule->rule_function);
+        }
+    }
+    return now_seconds() - start;
+}
+
+// Step a large grid with 1, 2, 4, ... max_threads threads and report the
+// scaling; every thread count has to give the same grid
+static int thread_scaling(struct bench_rule *rule, int max_threads) {
+    struct grid serial;
+    int failed = 0;
+    double serial_rate = 0;
+
+    initialize_grid(&serial, scaling_size, scaling_size, rule->states, mallocpalette(rule->states), seed);
+    update_grid(&serial, rule->rule_function); // Warm up caches and the rule tables
+
+    // 1, 2, 4, ... threads, always ending with max_threads
+    for (int threads = 1; ; threads = (threads * 2 < max_threads) ? threads * 2 : max_threads) {
+        struct grid grid;
+        initialize_grid(&grid, scaling_size, scaling_size, rule->states, mallocpalette(rule->states), seed);
+        update_grid(&grid, rule->rule_function);
+        grid.pool = create_thread_pool(threads);
+
+        double rate = generations / time_generations(&grid, rule, 0);
+        if (threads == 1) {
+            serial_rate = rate;
+            time_generations(&serial, rule, 0);
+        }
+        int same = grids_equal(&serial, &grid);
+        failed |= !same;
+
+        printf("%-10s %5dx%-5d %7d %14.1f %8.2fx%s\n", rule->name, scaling_size, scaling_size, threads,
+               rate, rate / serial_rate, same ? "" : "  MISMATCH");
+        destroy_thread_pool(grid.pool);
+        free_grid(&grid);
+        if (threads == max_threads) break;
+    }
+    free_grid(&serial);
+    return failed;
+}
+
+// Step a large grid generation by generation and with temporal blocking, and
+// check that both end in the same state. update_grid_generations only blocks
+// where this comes out ahead on the machine's caches.
+static int temporal_blocking(struct bench_rule *rule) {
+    struct grid plain, blocked;
+    const struct rule *parsed = builtin_rule(rule->rule_function);
+
+    initialize_grid(&plain, blocking_size, blocking_size, rule->states, mallocpalette(rule->states), seed);
+    initialize_grid(&blocked, blocking_size, blocking_size, rule->states, mallocpalette(rule->states), seed);
+
+    double plain_time = time_generations(&plain, rule, 0);
+    double start = now_seconds();
+    update_grid_blocked(&blocked, parsed, generations);
+    double blocked_time = now_seconds() - start;
+    int same = grids_equal(&plain, &blocked);
+
+    printf("%-10s %5dx%-5d %14.1f %14.1f %8.2fx%s\n", rule->name, blocking_size, blocking_size,
+           generations / plain_time, generations / blocked_time, plain_time / blocked_time,
+           same ? "" : "  MISMATCH");
+    free_grid(&plain);
+    free_grid(&blocked);
+    return !same;
+}
+
+// Step the same grid with and without statistics, which must agree with a
+// fresh count of the last generation
+static int statistics(struct bench_rule *rule) {
+    struct grid plain, counted;
+    initialize_grid(&plain, blocking_size, blocking_size, rule->states, mallocpalette(rule->states), seed);
+    initialize_grid(&counted, blocking_size, blocking_size, rule->states, mallocpalette(rule->states), seed);
+    enable_grid_stats(&counted);
+
+    double plain_time = time_generations(&plain, rule, 0);
+    double counted_time = time_generations(&counted, rule, 0);
+    uint64_t live = live_cells(&counted);
+    recount_grid_stats(&counted);
+    int same = grids_equal(&plain, &counted) && live == live_cells(&counted);
+
+    printf("%-10s %5dx%-5d %14.1f %14.1f %8.1f%%%s\n", rule->name, blocking_size, blocking_size,
+           generations / plain_time, generations / counted_time, (counted_time / plain_time - 1) * 100,
+           same ? "" : "  MISMATCH");
+    free_grid(&plain);
+    free_grid(&counted);
+    return !same;
+}
+
+// Clear everything but a square patch in the middle of the grid
+static void keep_center_patch(struct grid *grid, int patch) {
+    int x0 = (grid->width - patch) / 2, y0 = (grid->height - patch) / 2;
+    for (int y = 0; y < grid->height; y++) {
+        for (int x = 0; x < grid->width; x++) {
+            if (x < x0 || x >= x0 + patch || y < y0 || y >= y0 + patch) {
+                set_cell(grid, current_cells(grid), x, y, 0);
+            }
+        }
+    }
+}
+
+// Step a mostly empty grid with and without changed-tile tracking
+static int activity_tracking(struct bench_rule *rule) {
+    struct grid plain, tracked;
+
+    initialize_grid(&plain, activity_size, activity_size, rule->states, mallocpalette(rule->states), seed);
+    keep_center_patch(&plain, activity_size / 8);
+    initialize_grid(&tracked, activity_size, activity_size, rule->states, mallocpalette(rule->states), seed);
+    keep_center_patch(&tracked, activity_size / 8);
+    enable_activity_tracking(&tracked);
+
+    double plain_time = time_generations(&plain, rule, 0);
+    double tracked_time = time_generations(&tracked, rule, 0);
+    int same = grids_equal(&plain, &tracked);
+    int changed;
+    changed_tiles(&tracked, &changed);
+
+    printf("%-10s %5dx%-5d %14.1f %14.1f %8.2fx %6d/%d tiles%s\n", rule->name, activity_size, activity_size,
+           generations / plain_time, generations / tracked_time, plain_time / tracked_time,
+           changed, tracked.activity->tiles_x * tracked.activity->tiles_y, same ? "" : "  MISMATCH");
+    free_grid(&plain);
+    free_grid(&tracked);
+    return !same;
+}
+
+// Step a sparse two-state grid densely and through HashLife
+static int hashlife_compare(struct bench_rule *rule) {
+    struct grid plain, exported;
+    const struct rule *parsed = builtin_rule(rule->rule_function);
+
+    initialize_grid(&plain, activity_size, activity_size, rule->states, mallocpalette(rule->states), seed);
+    keep_center_patch(&plain, activity_size / 8);
+    initialize_grid(&exported, activity_size, activity_size, rule->states, mallocpalette(rule->states), seed);
+
+    struct hashlife *hashlife = create_hashlife(parsed);
+    if (!hashlife) {
+        free_grid(&plain);
+        free_grid(&exported);
+        return 1;
+    }
+    double start = now_seconds();
+    hashlife_import(hashlife, &plain);
+    hashlife_advance(hashlife, generations);
+    hashlife_export(hashlife, &exported);
+    double hashlife_time = now_seconds() - start;
+
+    double plain_time = time_generations(&plain, rule, 0);
+    int same = grids_equal(&plain, &exported);
+
+    printf("%-10s %5dx%-5d %14.1f %14.1f %8.2fx %9zu nodes%s\n", rule->name, activity_size, activity_size,
+           generations / plain_time, generations / hashlife_time, plain_time / hashlife_time,
+           hashlife_node_count(hashlife), same ? "" : "  MISMATCH");
+    destroy_hashlife(hashlife);
+    free_grid(&plain);
+    free_grid(&exported);
+    return !same;
+}
+
+// Step a sparse grid densely and as a chunked world, comparing their memory
+static int sparse_world(struct bench_rule *rule) {
+    struct grid plain, exported;
+    const struct rule *parsed = builtin_rule(rule->rule_function);
+
+    initialize_grid(&plain, activity_size, activity_size, rule->states, mallocpalette(rule->states), seed);
+    keep_center_patch(&plain, activity_size / 8);
+    allocate_grid(&exported, activity_size, activity_size, rule->states, mallocpalette(rule->states));
+
+    struct world *world = create_world(parsed, rule->states);
+    if (!world) {
+        free_grid(&plain);
+        free_grid(&exported);
+        return 1;
+    }
+    double start = now_seconds();
+    world_import(world, &plain, 0, 0);
+    advance_world(world, generations);
+    world_export(world, &exported, 0, 0);
+    double world_time = now_seconds() - start;
+
+    double plain_time = time_generations(&plain, rule, 0);
+    int same = grids_equal(&plain, &exported);
+    double dense_mb = 2.0 * plain.stride * (plain.height + 2) / (1 << 20);
+    double world_mb = (double)world->chunk_count * 2 * world->chunks[0]->grid.stride * (CHUNK_SIZE + 2) / (1 << 20);
+
+    printf("%-10s %5dx%-5d %14.1f %14.1f %8.2fx %6zu chunks, %.1f of %.1f MB%s\n", rule->name, activity_size,
+           activity_size, generations / plain_time, generations / world_time, plain_time / world_time,
+           world->chunk_count, world_mb, dense_mb, same ? "" : "  MISMATCH");
+    destroy_world(world);
+    free_grid(&plain);
+    free_grid(&exported);
+    return !same;
+}
+
+// Step many small grids one after another on the pool, then as one ensemble
+static int ensemble_batch(struct bench_rule *rule, int max_threads) {
+    const struct rule *parsed = builtin_rule(rule->rule_function);
+    struct thread_pool *pool = create_thread_pool(max_threads);
+    struct ensemble_member *members = malloc(ensemble_members * sizeof(struct ensemble_member));
+    if (!members) {
+        fprintf(stderr, "Memory allocation failed for ensemble!\n");
+        exit(1);
+    }
+    for (int i = 0; i < ensemble_members; i++) {
+        members[i] = (struct ensemble_member){ensemble_size, ensemble_size, rule->states, BOUNDARY_DEAD, parsed, seed + i};
+    }
+
+    double start = now_seconds();
+    struct ensemble *ensemble = create_ensemble(members, ensemble_members, pool);
+    step_ensemble(ensemble, generations);
+    double ensemble_time = now_seconds() - start;
+
+    int same = 1;
+    start = now_seconds();
+    for (int i = 0; i < ensemble_members; i++) {
+        struct grid grid;
+        initialize_grid(&grid, ensemble_size, ensemble_size, rule->states, mallocpalette(rule->states), seed + i);
+        grid.pool = pool;
+        time_generations(&grid, rule, 0);
+        same &= grids_equal(&grid, &ensemble->grids[i]);
+        free_grid(&grid);
+    }
+    double separate_time = now_seconds() - start;
+
+    printf("%-10s %4d x %3dx%-3d %14.1f %14.1f %8.2fx%s\n", rule->name, ensemble_members, ensemble_size,
+           ensemble_size, ensemble_members * generations / separate_time, ensemble_members * generations / ensemble_time,
+           separate_time / ensemble_time, same ? "" : "  MISMATCH");
+    destroy_ensemble(ensemble);
+    free(members);
+    destroy_thread_pool(pool);
+    return !same;
+}
+
+// Fill a large grid from the seed with 1 and max_threads threads, which must agree
+static int random_fill(struct bench_rule *rule, int max_threads) {
+    struct grid serial, parallel;
+    allocate_grid(&serial, blocking_size, blocking_size, rule->states, mallocpalette(rule->states));
+    allocate_grid(&parallel, blocking_size, blocking_size, rule->states, mallocpalette(rule->states));
+    parallel.pool = create_thread_pool(max_threads);
+
+    double start = now_seconds();
+    initialize_random_grid(&serial, serial.grid1, seed);
+    double middle = now_seconds();
+    initialize_random_grid(&parallel, parallel.grid1, seed);
+    double end = now_seconds();
+    int same = grids_equal(&serial, &parallel);
+
+    double cells = (double)blocking_size * blocking_size;
+    printf("%-10s %5dx%-5d %7d %14.1f %14.1f %8.2fx%s\n", rule->name, blocking_size, blocking_size, max_threads,
+           cells / (middle - start) * 1e-6, cells / (end - middle) * 1e-6, (middle - start) / (end - middle),
+           same ? "" : "  MISMATCH");
+    destroy_thread_pool(parallel.pool);
+    free_grid(&serial);
+    free_grid(&parallel);
+    return !same;
+}
+
+// The rule being stepped cell by cell through count_neighborhood
+static struct rule counted_rule;
+
+static int counted_neighborhood_rule(int x, int y, const uint8_t *cells, struct grid *grid) {
+    const struct rule *rule = &counted_rule;
+    int state = get_cell(grid, cells, x, y);
+    int count = count_neighborhood(x, y, cells, grid, &rule->neighborhood);
+    if (rule->kind == RULE_LIFE_LIKE) {
+        return rule->table[state][count];
+    }
+    if (state == 1) {
+        int kept = count >= rule->survive_min && count <= rule->survive_max;
+        return kept ? 1 : (rule->states > 2 ? 2 : 0);
+    }
+    if (state > 1) {
+        return (state + 1) % rule->states;
+    }
+    return count >= rule->birth_min && count <= rule->birth_max;
+}
+
+// Step a rule with a wider or other neighborhood through its kernel and cell
+// by cell, which must agree. The kernel should take about as long whatever
+// the radius of a Moore range.
+static int neighborhood_rule(const char *name, const char *text) {
+    struct grid per_cell, kernel;
+    if (parse_rule(text, &counted_rule) != 0) {
+        printf("%-10s cannot parse %s\n", name, text);
+        return 1;
+    }
+    int states = counted_rule.states;
+    initialize_grid(&per_cell, neighborhood_size, neighborhood_size, states, mallocpalette(states), seed);
+    initialize_grid(&kernel, neighborhood_size, neighborhood_size, states, mallocpalette(states), seed);
+
+    double start = now_seconds();
+    for (int i = 0; i < neighborhood_generations; i++) {
+        update_grid_per_cell(&per_cell, counted_neighborhood_rule);
+    }
+    double per_cell_time = now_seconds() - start;
+    start = now_seconds();
+    for (int i = 0; i < neighborhood_generations; i++) {
+        update_grid_with_rule(&kernel, &counted_rule);
+    }
+    double kernel_time = now_seconds() - start;
+    int same = grids_equal(&per_cell, &kernel);
+
+    printf("%-10s %5dx%-5d %14.1f %14.1f %8.1fx %s%s\n", name, neighborhood_size, neighborhood_size,
+           neighborhood_generations / per_cell_time, neighborhood_generations / kernel_time,
+           per_cell_time / kernel_time, text, same ? "" : "  MISMATCH");
+    free_grid(&per_cell);
+    free_grid(&kernel);
+    return !same;
+}
+
+// Create, fill, step and free a large grid lifetimes times, returning its
+// memory to the system after each one unless reuse is set. The grid takes
+// sizes different sizes in turn, each 64 cells narrower than the last.
+// Returns the seconds taken, the page faults in faults and the bytes the
+// arena still keeps in kept.
+static double grid_lifetimes(struct bench_rule *rule, int reuse, int sizes, long *faults, size_t *kept) {
+    struct memory_stats before, after;
+    get_memory_stats(&before);
+    double start = now_seconds();
+    for (int i = 0; i < lifetimes; i++) {
+        struct grid grid;
+        int width = blocking_size - 64 * (i % sizes);
+        initialize_grid(&grid, width, blocking_size, rule->states, mallocpalette(rule->states), seed + i);
+        update_grid(&grid, rule->rule_function);
+        free_grid(&grid);
+        if (!reuse) {
+            release_kept_blocks();
+        }
+    }
+    double seconds = now_seconds() - start;
+    get_memory_stats(&after);
+    *faults = after.minor_faults - before.minor_faults;
+    *kept = after.kept_bytes;
+    return seconds;
+}
+
+// The same size every time, a few sizes in turn as when resizing back and
+// forth, and a new size every time, which nothing kept can serve
+static void grid_memory(struct bench_rule *rule) {
+    int sizes[] = {1, 3, lifetimes};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        long fresh_faults, reused_faults;
+        size_t kept;
+        double fresh = grid_lifetimes(rule, 0, sizes[s], &fresh_faults, &kept);
+        double reused = grid_lifetimes(rule, 1, sizes[s], &reused_faults, &kept);
+        release_kept_blocks();
+        printf("%-10s %5dx%-5d %6d %14.1f %14.1f %9.2fx %8ld / %-8ld %8.1f\n", rule->name, blocking_size,
+               blocking_size, sizes[s], lifetimes / fresh, lifetimes / reused, fresh / reused,
+               fresh_faults / lifetimes, reused_faults / lifetimes, kept / 1048576.0);
+    }
+}
+
+// Time drawing frames one rectangle per cell and through the streaming
+// texture, stepping in between. main picks the dummy video driver unless
+// SDL_VIDEODRIVER says otherwise.
+static void rendering(struct bench_rule *rule) {
+    struct grid grid;
+    struct color start = {255, 228, 196}, end = {139, 143, 67};
+    initialize_grid(&grid, render_size, render_size, rule->states, mallocpalette(rule->states), seed);
+    initialize_gradient_palette(grid.palette, &start, &end, rule->states);
+    struct grid_texture *texture = create_grid_texture(&grid);
+
+    double rects_time = 0, texture_time = 0;
+    for (int i = 0; i < generations; i++) {
+        update_grid(&grid, rule->rule_function);
+        double start = now_seconds();
+        draw_grid(&grid);
+        present_window();
+        double middle = now_seconds();
+        render_grid(texture, &grid);
+        present_window();
+        texture_time += now_seconds() - middle;
+        rects_time += middle - start;
+    }
+
+    printf("%-10s %5dx%-5d %14.3f %14.3f %8.2fx\n", rule->name, render_size, render_size,
+           rects_time * 1e3 / generations, texture_time * 1e3 / generations, rects_time / texture_time);
+    destroy_grid_texture(texture);
+    free_grid(&grid);
+}
+
+struct matrix_result {
+    const char *rule;
+    int states;
+    int size;
+    int threads;
+    unsigned int seed;
+    int generations;
+    double seconds;
+    double checkpoint_copy_ms;      // Handing the grid to the checkpoint writer
+    double checkpoint_write_ms;     // The writer saving it to disk
+    double render_ms;               // Converting, uploading and drawing one frame
+};
+
+static double cells_per_second(const struct matrix_result *result) {
+    return (double)result->size * result->size * result->generations / result->seconds;
+}
+
+// Step one matrix entry from its seed, then checkpoint and render the result
+static void run_matrix_entry(struct bench_rule *rule, int states, int size, int threads, unsigned int entry_seed,
+                             const char *snapshot_path, struct matrix_result *result) {
+    struct grid grid;
+    struct color start = {255, 228, 196}, end = {139, 143, 67};
+    initialize_grid(&grid, size, size, states, mallocpalette(states), entry_seed);
+    initialize_gradient_palette(grid.palette, &start, &end, states);
+    struct thread_pool *pool = (threads > 1) ? create_thread_pool(threads) : NULL;
+    grid.pool = pool;
+
+    long cells = (long)size * size;
+    int entry_generations = (int)(matrix_work / cells);
+    entry_generations = (entry_generations < 10) ? 10 : (entry_generations > 1000) ? 1000 : entry_generations;
+    update_grid(&grid, rule->rule_function); // Warm up caches and the rule tables
+
+    double begin = now_seconds();
+    for (int i = 0; i < entry_generations; i++) {
+        update_grid(&grid, rule->rule_function);
+    }
+    result->seconds = now_seconds() - begin;
+
+    struct checkpoint_writer *writer = create_checkpoint_writer(&grid, 1, 1);
+    struct checkpoint_stats stats;
+    begin = now_seconds();
+    checkpoint_grid(writer, &grid, builtin_rule(rule->rule_function), entry_seed, snapshot_path);
+    result->checkpoint_copy_ms = (now_seconds() - begin) * 1e3;
+    destroy_checkpoint_writer(writer, &stats);
+    result->checkpoint_write_ms = stats.write_seconds * 1e3;
+    remove(snapshot_path);
+
+    struct grid_texture *texture = create_grid_texture(&grid);
+    render_grid(texture, &grid); // The first upload also allocates on the driver side
+    begin = now_seconds();
+    for (int i = 0; i < 10; i++) {
+        render_grid(texture, &grid);
+        present_window();
+    }
+    result->render_ms = (now_seconds() - begin) * 1e3 / 10;
+    destroy_grid_texture(texture);
+
+    result->rule = rule->name;
+    result->states = states;
+    result->size = size;
+    result->threads = threads;
+    result->seed = entry_seed;
+    result->generations = entry_generations;
+    grid.pool = NULL;
+    destroy_thread_pool(pool);
+    free_grid(&grid);
+}
+
+static void write_matrix_csv(const char *filename, const struct matrix_result *results, int count) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        fprintf(stderr, "Error opening %s!\n", filename);
+        return;
+    }
+    fprintf(file, "rule,states,width,height,threads,seed,generations,seconds,gens_per_sec,cells_per_sec,"
+                  "ns_per_cell,checkpoint_copy_ms,checkpoint_write_ms,render_ms\n");
+    for (int i = 0; i < count; i++) {
+        const struct matrix_result *r = &results[i];
+        fprintf(file, "%s,%d,%d,%d,%d,%u,%d,%.6f,%.3f,%.0f,%.4f,%.4f,%.4f,%.4f\n", r->rule, r->states, r->size,
+                r->size, r->threads, r->seed, r->generations, r->seconds, r->generations / r->seconds,
+                cells_per_second(r), 1e9 / cells_per_second(r), r->checkpoint_copy_ms, r->checkpoint_write_ms,
+                r->render_ms);
+    }
+    fclose(file);
+}
+
+static void write_matrix_json(const char *filename, const struct matrix_result *results, int count) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        fprintf(stderr, "Error opening %s!\n", filename);
+        return;
+    }
+    fprintf(file, "[\n");
+    for (int i = 0; i < count; i++) {
+        const struct matrix_result *r = &results[i];
+        fprintf(file, "  {\"rule\": \"%s\", \"states\": %d, \"width\": %d, \"height\": %d, \"threads\": %d, "
+                      "\"seed\": %u, \"generations\": %d, \"seconds\": %.6f, \"gens_per_sec\": %.3f, "
+                      "\"cells_per_sec\": %.0f, \"ns_per_cell\": %.4f, \"checkpoint_copy_ms\": %.4f, "
+                      "\"checkpoint_write_ms\": %.4f, \"render_ms\": %.4f}%s\n",
+                r->rule, r->states, r->size, r->size, r->threads, r->seed, r->generations, r->seconds,
+                r->generations / r->seconds, cells_per_second(r), 1e9 / cells_per_second(r),
+                r->checkpoint_copy_ms, r->checkpoint_write_ms, r->render_ms, (i + 1 < count) ? "," : "");
+    }
+    fprintf(file, "]\n");
+    fclose(file);
+}
+
+// Every rule over every size, and the cyclic rule over every state count,
+// timing stepping, a checkpoint and a rendered frame of each grid. Each
+// entry has its own fixed seed, so runs can be compared one to one; the
+// results can be written as CSV or JSON, and --matrix runs this alone.
+static void run_matrix(struct bench_rule *rules, int rule_count, int threads, const char *csv, const char *json) {
+    int sizes = sizeof(matrix_sizes) / sizeof(matrix_sizes[0]);
+    int state_counts = sizeof(matrix_cyclic_states) / sizeof(matrix_cyclic_states[0]);
+    struct matrix_result *results = malloc(rule_count * state_counts * sizes * sizeof(struct matrix_result));
+    if (!results) {
+        fprintf(stderr, "Memory allocation failed for bench!\n");
+        exit(1);
+    }
+
+    char snapshot_path[256];
+    const char *directory = getenv("TMPDIR");
+    snprintf(snapshot_path, sizeof(snapshot_path), "%s/automata_bench_%d.snap", directory ? directory : "/tmp", (int)getpid());
+
+    printf("%-10s %6s %-11s %7s %10s %12s %9s %10s %10s %10s\n", "rule", "states", "grid", "threads", "gens/sec",
+           "Mcells/sec", "ns/cell", "ckpt copy", "ckpt write", "render ms");
+    int count = 0;
+    for (int r = 0; r < rule_count; r++) {
+        int cyclic = (rules[r].rule_function == cyclic_rule);
+        for (int c = 0; c < (cyclic ? state_counts : 1); c++) {
+            int states = cyclic ? matrix_cyclic_states[c] : rules[r].states;
+            for (int s = 0; s < sizes; s++) {
+                struct matrix_result *result = &results[count];
+                run_matrix_entry(&rules[r], states, matrix_sizes[s], threads, seed + (unsigned int)count,
+                                 snapshot_path, result);
+                printf("%-10s %6d %5dx%-5d %7d %10.1f %12.1f %9.3f %10.3f %10.3f %10.3f\n", result->rule, states,
+                       result->size, result->size, threads, result->generations / result->seconds,
+                       cells_per_second(result) * 1e-6, 1e9 / cells_per_second(result),
+                       result->checkpoint_copy_ms, result->checkpoint_write_ms, result->render_ms);
+                count++;
+            }
+        }
+    }
+
+    if (csv) write_matrix_csv(csv, results, count);
+    if (json) write_matrix_json(json, results, count);
+    free(results);
+}
+
+static void print_usage(const char *program) {
+    printf("Usage: %s [options] [max_threads]\n"
+           "  -t, --threads N    threads stepping the matrix grids (1)\n"
+           "  -c, --csv FILE     write the matrix results as CSV\n"
+           "  -j, --json FILE    write the matrix results as JSON\n"
+           "  -m, --matrix       run only the matrix\n"
+           "  -h, --help         show this help\n", program);
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct option long_options[] = {
+        {"threads", required_argument, NULL, 't'},
+        {"csv", required_argument, NULL, 'c'},
+        {"json", required_argument, NULL, 'j'},
+        {"matrix", no_argument, NULL, 'm'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    int matrix_threads = 1, matrix_only = 0;
+    const char *csv = NULL, *json = NULL;
+    int option;
+    while ((option = getopt_long(argc, argv, "t:c:j:mh", long_options, NULL)) != -1) {
+        switch (option) {
+            case 't': matrix_threads = atoi(optarg); break;
+            case 'c': csv = optarg; break;
+            case 'j': json = optarg; break;
+            case 'm': matrix_only = 1; break;
+            case 'h': print_usage(argv[0]); return 0;
+            default: print_usage(argv[0]); return 1;
+        }
+    }
+    int max_threads = (optind < argc) ? atoi(argv[optind]) : available_cpus();
+    if (max_threads < 1) {
+        max_threads = 1;
+    }
+    if (matrix_threads < 1) {
+        matrix_threads = available_cpus();
+    }
+
+    struct bench_rule rules[] = {
+        {"life", conways_game_of_life_rule, 2},
+        {"highlife", highlife_rule, 2},
+        {"cyclic", cyclic_rule, 8},
+    };
+    int rule_count = sizeof(rules) / sizeof(rules[0]);
+    int sizes[] = {400, 1000};
+    int failed = 0;
+
+    // Rendering is timed on the dummy video driver unless told otherwise
+    setenv("SDL_VIDEODRIVER", "dummy", 0);
+    initialize_window("Bench", render_size * CELL_SIZE, render_size * CELL_SIZE);
+
+    run_matrix(rules, rule_count, matrix_threads, csv, json);
+    if (matrix_only) {
+        cleanup();
+        return 0;
+    }
+
+    // The specialized kernels against the per-cell rule callback, on byte
+    // grids once per instruction set the CPU supports. The cyclic rule also
+    // runs on a two-state bit grid, whose dead halo reads as state 0.
+    struct bench_rule kernel_rules[] = {rules[0], rules[1], rules[2], {"cyclic-2", cyclic_rule, 2}};
+    printf("\n%-10s %-11s %-7s %14s %14s %9s\n", "rule", "grid", "isa", "per-cell ns", "kernel ns", "speedup");
+    for (size_t r = 0; r < sizeof(kernel_rules) / sizeof(kernel_rules[0]); r++) {
+        struct bench_rule *rule = &kernel_rules[r];
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            int size = sizes[s];
+            double cells = (double)size * size * generations;
+            struct grid reference;
+
+            initialize_grid(&reference, size, size, rule->states, mallocpalette(rule->states), seed);
+            double per_cell = time_generations(&reference, rule, 1);
+
+            // Bit grids have a single word-parallel kernel
+            int last_isa = (reference.format == CELL_FORMAT_BYTES) ? detect_kernel_isa() : KERNEL_ISA_SCALAR;
+            for (int isa = KERNEL_ISA_SCALAR; isa <= last_isa; isa++) {
+                struct grid specialized;
+                set_kernel_isa(isa);
+                initialize_grid(&specialized, size, size, rule->states, mallocpalette(rule->states), seed);
+
+                double kernel = time_generations(&specialized, rule, 0);
+                int same = grids_equal(&reference, &specialized);
+                failed |= !same;
+
+                printf("%-10s %5dx%-5d %-7s %14.2f %14.2f %8.1fx%s\n", rule->name, size, size,
+                       reference.format == CELL_FORMAT_BITS ? "swar" : kernel_isa_name(isa),
+                       per_cell * 1e9 / cells, kernel * 1e9 / cells, per_cell / kernel,
+                       same ? "" : "  MISMATCH");
+                free_grid(&specialized);
+            }
+            set_kernel_isa(-1);
+            free_grid(&reference);
+        }
+    }
+
+    printf("\n%-10s %-11s %7s %14s %9s\n", "rule", "grid", "threads", "gens/sec", "scaling");
+    for (size_t r = 0; r < sizeof(rules) / sizeof(rules[0]); r++) {
+        failed |= thread_scaling(&rules[r], max_threads);
+    }
+
+    printf("\n%-10s %-11s %14s %14s %9s\n", "rule", "grid", "gens/sec", "blocked", "speedup");
+    for (size_t r = 0; r < sizeof(rules) / sizeof(rules[0]); r++) {
+        failed |= temporal_blocking(&rules[r]);
+    }
+
+    printf("\n%-10s %-11s %14s %14s %9s\n", "rule", "grid", "gens/sec", "counted", "overhead");
+    for (size_t r = 0; r < sizeof(rules) / sizeof(rules[0]); r++) {
+        failed |= statistics(&rules[r]);
+    }
+
+    printf("\n%-10s %-11s %14s %14s %9s %s\n", "rule", "grid", "gens/sec", "tracked", "speedup", "changed");
+    for (size_t r = 0; r < sizeof(rules) / sizeof(rules[0]); r++) {
+        failed |= activity_tracking(&rules[r]);
+    }
+
+    printf("\n%-10s %-11s %14s %14s %9s %s\n", "rule", "grid", "gens/sec", "hashlife", "speedup", "memo");
+    for (size_t r = 0; r < sizeof(rules) / sizeof(rules[0]); r++) {
+        if (rules[r].states == 2) {
+            failed |= hashlife_compare(&rules[r]);
+        }
+    }
+
+    printf("\n%-10s %-11s %14s %14s %9s %s\n", "rule", "grid", "gens/sec", "chunked", "speedup", "memory");
+    for (size_t r = 0; r < sizeof(rules) / sizeof(rules[0]); r++) {
+        failed |= sparse_world(&rules[r]);
+    }
+
+    printf("\n%-10s %-15s %14s %14s %9s\n", "rule", "members", "grid gens/s", "ensemble", "speedup");
+    for (size_t r = 0; r < sizeof(rules) / sizeof(rules[0]); r++) {
+        failed |= ensemble_batch(&rules[r], max_threads);
+    }
+
+    printf("\n%-10s %-11s %7s %14s %14s %9s\n", "rule", "grid", "threads", "fill Mcells/s", "parallel", "speedup");
+    for (size_t r = 0; r < sizeof(rules) / sizeof(rules[0]); r++) {
+        failed |= random_fill(&rules[r], max_threads);
+    }
+
+    // Moore ranges of growing radius, then the other neighborhoods
+    const char *neighborhoods[][2] = {
+        {"ltl-r1", "R1,C0,M0,S2..3,B3..3,NM"},
+        {"ltl-r2", "R2,C0,M1,S4..7,B4..5,NM"},
+        {"bosco", "R5,C0,M1,S34..58,B34..45,NM"},
+        {"ltl-r10", "R10,C0,M1,S122..211,B123..170"},
+        {"ltl-r20", "R20,C0,M1,S500..840,B500..680"},
+        {"diamond-r5", "R5,C0,M1,S20..32,B20..26,NN"},
+        {"hex", "B2/S34H"},
+        {"vonneumann", "B1/S012V"},
+    };
+    printf("\n%-10s %-11s %14s %14s %9s %s\n", "rule", "grid", "per-cell g/s", "kernel g/s", "speedup", "rule");
+    for (size_t n = 0; n < sizeof(neighborhoods) / sizeof(neighborhoods[0]); n++) {
+        failed |= neighborhood_rule(neighborhoods[n][0], neighborhoods[n][1]);
+    }
+
+    printf("\n%-10s %-11s %6s %14s %14s %9s %19s %8s\n", "rule", "grid", "sizes", "lifetimes/s", "reused", "speedup",
+           "faults", "kept MiB");
+    for (size_t r = 0; r < sizeof(rules) / sizeof(rules[0]); r++) {
+        grid_memory(&rules[r]);
+    }
+
+    printf("\n%-10s %-11s %14s %14s %9s\n", "rule", "grid", "rects ms", "texture ms", "speedup");
+    for (size_t r = 0; r < sizeof(rules) / sizeof(rules[0]); r++) {
+        rendering(&rules[r]);
+    }
+    cleanup();
+
+    return failed;
+}
@@ -0,0 +1,177 @@
+#include "checkpoint.h"
+#include "snapshot.h"
+#include "profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Writer loop: save the oldest filled slot, free it, repeat until stopped
+// with nothing left to write
+static void *writer_main(void *arg) {
+    struct checkpoint_writer *writer = arg;
+
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        while (writer->count == 0 && !writer->stopping) {
+            pthread_cond_wait(&writer->queued, &writer->lock);
+        }
+        if (writer->count == 0) break;
+        struct checkpoint_slot *slot = &writer->slots[writer->head];
+        pthread_mutex_unlock(&writer->lock);
+
+        // The slot is ours until head moves past it
+        double start = now_seconds();
+        PROFILE_BEGIN(PHASE_SAVE);
+        int result = save_snapshot(&slot->layout, slot->has_rule ? &slot->rule : NULL, slot->seed, slot->filename);
+        PROFILE_END(PHASE_SAVE);
+        double elapsed = now_seconds() - start;
+        free(slot->filename);
+        slot->filename = NULL;
+
+        pthread_mutex_lock(&writer->lock);
+        writer->stats.write_seconds += elapsed;
+        if (result == 0) {
+            writer->stats.written++;
+        } else {
+            writer->stats.failed++;
+        }
+        writer->head = (writer->head + 1) % writer->depth;
+        writer->count--;
+        pthread_cond_signal(&writer->freed);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+// Start a writer for grids shaped like this one, with depth slots (at least 1).
+// A full queue makes checkpoint_grid wait if block_when_full is set, and
+// drop the checkpoint otherwise.
+struct checkpoint_writer *create_checkpoint_writer(const struct grid *grid, int depth, int block_when_full) {
+    struct checkpoint_writer *writer = calloc(1, sizeof(struct checkpoint_writer));
+    if (!writer) {
+        fprintf(stderr, "Memory allocation failed for checkpoint writer!\n");
+        exit(1);
+    }
+    writer->depth = (depth < 1) ? 1 : depth;
+    writer->block_when_full = block_when_full;
+    writer->cell_bytes = grid->stride * (grid->height + 2);
+    writer->slots = calloc(writer->depth, sizeof(struct checkpoint_slot));
+    if (!writer->slots) {
+        fprintf(stderr, "Memory allocation failed for checkpoint writer!\n");
+        exit(1);
+    }
+    for (int i = 0; i < writer->depth; i++) {
+        writer->slots[i].cells = mallocgrid(writer->cell_bytes);
+    }
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->queued, NULL);
+    pthread_cond_init(&writer->freed, NULL);
+
+    if (pthread_create(&writer->thread, NULL, writer_main, writer) != 0) {
+        fprintf(stderr, "Could not start checkpoint writer thread!\n");
+        exit(1);
+    }
+    return writer;
+}
+
+// Write out everything still queued, then stop the thread and free the
+// writer. The final statistics go to stats unless it is NULL.
+void destroy_checkpoint_writer(struct checkpoint_writer *writer, struct checkpoint_stats *stats) {
+    if (!writer) return;
+
+    pthread_mutex_lock(&writer->lock);
+    writer->stopping = 1;
+    pthread_cond_signal(&writer->queued);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+    if (stats) {
+        *stats = writer->stats;
+    }
+
+    for (int i = 0; i < writer->depth; i++) {
+        free_cells(writer->slots[i].cells, writer->cell_bytes);
+        free(writer->slots[i].filename);
+    }
+    free(writer->slots);
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->queued);
+    pthread_cond_destroy(&writer->freed);
+    free(writer);
+}
+
+// Queue a snapshot of the grid's current generation to be saved to filename.
+// The grid must have the shape the writer was created for; the rule may be
+// NULL. Checkpoints come from one thread at a time. Returns 0 once the cells
+// are copied and -1 if the queue was full and the checkpoint was dropped.
+int checkpoint_grid(struct checkpoint_writer *writer, const struct grid *grid, const struct rule *rule,
+                    uint64_t seed, const char *filename) {
+    if (grid->stride * (grid->height + 2) != writer->cell_bytes) {
+        fprintf(stderr, "Checkpoint grid does not match the writer's grid size\n");
+        exit(1);
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    writer->stats.submitted++;
+    if (writer->count == writer->depth) {
+        if (!writer->block_when_full) {
+            writer->stats.dropped++;
+            pthread_mutex_unlock(&writer->lock);
+            return -1;
+        }
+        writer->stats.stalls++;
+        double start = now_seconds();
+        while (writer->count == writer->depth) {
+            pthread_cond_wait(&writer->freed, &writer->lock);
+        }
+        writer->stats.stall_seconds += now_seconds() - start;
+    }
+    struct checkpoint_slot *slot = &writer->slots[(writer->head + writer->count) % writer->depth];
+    pthread_mutex_unlock(&writer->lock);
+
+    // Only this caller touches a free slot, so the copy runs unlocked
+    memcpy(slot->cells, current_cells(grid), writer->cell_bytes);
+    slot->layout = *grid;
+    slot->layout.grid1 = slot->cells;
+    slot->layout.grid2 = slot->cells;
+    slot->layout.current = 0;
+    slot->layout.pool = NULL;
+    slot->layout.activity = NULL;
+    slot->layout.hash = NULL;
+    slot->layout.stats = NULL;
+    slot->layout.windows = NULL;
+    slot->layout.window_count = 0;
+    slot->layout.temporal_tiles = NULL;
+    slot->layout.temporal_bytes = 0;
+    slot->has_rule = (rule != NULL);
+    if (rule) {
+        slot->rule = *rule;
+    }
+    slot->seed = seed;
+    slot->filename = strdup(filename);
+    if (!slot->filename) {
+        fprintf(stderr, "Memory allocation failed for checkpoint writer!\n");
+        exit(1);
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    writer->count++;
+    if (writer->count > writer->stats.max_queued) {
+        writer->stats.max_queued = writer->count;
+    }
+    pthread_cond_signal(&writer->queued);
+    pthread_mutex_unlock(&writer->lock);
+    return 0;
+}
+
+void get_checkpoint_stats(struct checkpoint_writer *writer, struct checkpoint_stats *stats) {
+    pthread_mutex_lock(&writer->lock);
+    *stats = writer->stats;
+    pthread_mutex_unlock(&writer->lock);
+}
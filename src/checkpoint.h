@@ -0,0 +1,54 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <pthread.h>
+#include "grid.h"
+#include "rule.h"
+
+// Writes snapshots on a background thread. checkpoint_grid only copies the
+// cells into a free slot of a bounded queue and returns; the writer thread
+// saves the slots in order with save_snapshot. When every slot is taken the
+// caller either waits for one or drops the checkpoint, and both are counted.
+struct checkpoint_slot {
+    struct grid layout;         // The grid's fields, with grid1 pointing at cells
+    uint8_t *cells;
+    struct rule rule;
+    int has_rule;
+    uint64_t seed;
+    char *filename;
+};
+
+struct checkpoint_stats {
+    uint64_t submitted;         // Checkpoints handed to checkpoint_grid
+    uint64_t written;
+    uint64_t failed;            // Could not be saved
+    uint64_t dropped;           // Found the queue full and were skipped
+    uint64_t stalls;            // Found the queue full and waited
+    double stall_seconds;       // Time callers spent waiting for a slot
+    double write_seconds;       // Time the writer thread spent saving
+    int max_queued;
+};
+
+struct checkpoint_writer {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t queued;      // A slot was filled or the writer is stopping
+    pthread_cond_t freed;       // A slot was written
+    struct checkpoint_slot *slots;
+    int depth;
+    int head;                   // Oldest filled slot
+    int count;                  // Filled slots, including the one being written
+    int block_when_full;
+    int stopping;
+    size_t cell_bytes;
+    struct checkpoint_stats stats;
+};
+
+struct checkpoint_writer *create_checkpoint_writer(const struct grid *grid, int depth, int block_when_full);
+void destroy_checkpoint_writer(struct checkpoint_writer *writer, struct checkpoint_stats *stats);
+
+int checkpoint_grid(struct checkpoint_writer *writer, const struct grid *grid, const struct rule *rule,
+                    uint64_t seed, const char *filename);
+void get_checkpoint_stats(struct checkpoint_writer *writer, struct checkpoint_stats *stats);
+
+#endif
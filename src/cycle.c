@@ -0,0 +1,198 @@
+#include "cycle.h"
+#include "activity.h"
+#include "random.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HASH_SECRET0 0xA0761D6478BD642FULL
+#define HASH_SECRET1 0xE7037ED1A0B428DBULL
+
+static void *malloc_hashing(size_t size) {
+    void *data = malloc(size);
+    if (!data) {
+        fprintf(stderr, "Memory allocation failed for grid hashing!\n");
+        exit(1);
+    }
+    return data;
+}
+
+// Multiply to 128 bits and fold the halves together
+static inline uint64_t fold_multiply(uint64_t a, uint64_t b) {
+    __uint128_t product = (__uint128_t)a * b;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+static inline uint64_t load_word(const uint8_t *data) {
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    return word;
+}
+
+// Hash count words, the first and last of them passed in already masked and
+// the ones between read from data. Two lanes with one wide multiply per pair
+// of words keep the multiplier busy.
+static uint64_t hash_words(const uint8_t *data, size_t count, uint64_t first, uint64_t last) {
+    uint64_t a = HASH_SECRET0 ^ count, b = HASH_SECRET1 ^ first;
+    size_t i = 1, end = (count > 1) ? count - 1 : 1;
+    for (; i + 4 <= end; i += 4) {
+        a = fold_multiply(load_word(data + i * 8) ^ HASH_SECRET1, load_word(data + i * 8 + 8) ^ a);
+        b = fold_multiply(load_word(data + i * 8 + 16) ^ HASH_SECRET0, load_word(data + i * 8 + 24) ^ b);
+    }
+    for (; i < end; i++) {
+        a = fold_multiply(load_word(data + i * 8) ^ HASH_SECRET1, a ^ HASH_SECRET0);
+    }
+    if (count > 1) {
+        b = fold_multiply(last ^ HASH_SECRET1, b ^ HASH_SECRET0);
+    }
+    return mix64(a ^ mix64(b));
+}
+
+// Hash of the cells of row y, leaving out the halo and the row padding
+uint64_t hash_grid_row(const struct grid *grid, const uint8_t *cells, int y) {
+    const uint8_t *row = grid_row(grid, cells, y);
+    size_t width = (size_t)grid->width;
+
+    if (grid->format == CELL_FORMAT_BITS) {
+        // Bit 0 is the left halo, bits 1 to width the cells
+        size_t count = (width + 1 + 63) / 64;
+        uint64_t last_mask = ((uint64_t)2 << (width & 63)) - 1;
+        uint64_t first = load_word(row) & ~(uint64_t)1;
+        if (count == 1) {
+            return hash_words(row, 1, first & last_mask, 0);
+        }
+        return hash_words(row, count, first, load_word(row + (count - 1) * 8) & last_mask);
+    }
+
+    // Byte cells start after the halo byte; the last word may be partial
+    const uint8_t *data = row + 1;
+    size_t count = (width + 7) / 8;
+    uint64_t first = 0, last = 0;
+    memcpy(&first, data, width < 8 ? width : 8);
+    memcpy(&last, data + (count - 1) * 8, width - (count - 1) * 8);
+    return hash_words(data, count, first, last);
+}
+
+void hash_grid_rows(struct grid *grid, const uint8_t *cells, int y0, int y1) {
+    for (int y = y0; y < y1; y++) {
+        grid->hash->rows[y] = hash_grid_row(grid, cells, y);
+    }
+}
+
+// Hash the rows of the tiles that changed in the last generation again.
+// Every other row is the same as in the generation before.
+void rehash_changed_rows(struct grid *grid, const uint8_t *cells) {
+    int count;
+    const int *tiles = changed_tiles(grid, &count);
+    int tiles_x = grid->activity->tiles_x;
+    int last_row = -1;
+    for (int i = 0; i < count; i++) {
+        int ty = tiles[i] / tiles_x;
+        if (ty == last_row) continue;   // The list is in tile order
+        last_row = ty;
+        int y1 = (ty + 1) * TILE_SIZE < grid->height ? (ty + 1) * TILE_SIZE : grid->height;
+        hash_grid_rows(grid, cells, ty * TILE_SIZE, y1);
+    }
+}
+
+// Combine the row hashes into the hash of the generation
+void finish_grid_hash(struct grid *grid) {
+    uint64_t value = 0;
+    for (int y = 0; y < grid->height; y++) {
+        value += mix64(grid->hash->rows[y] + (uint64_t)y * 0x9E3779B97F4A7C15ULL);
+    }
+    grid->hash->value = mix64(value ^ (uint64_t)grid->width << 32 ^ (uint64_t)grid->height);
+}
+
+// Hash every row of the current generation from scratch
+void rehash_grid(struct grid *grid) {
+    if (!grid->hash) return;
+    hash_grid_rows(grid, current_cells(grid), 0, grid->height);
+    finish_grid_hash(grid);
+}
+
+void enable_grid_hashing(struct grid *grid) {
+    if (grid->hash) return;
+    grid->hash = malloc_hashing(sizeof(struct grid_hash));
+    grid->hash->rows = malloc_hashing((size_t)grid->height * sizeof(uint64_t));
+    rehash_grid(grid);
+}
+
+void disable_grid_hashing(struct grid *grid) {
+    if (!grid->hash) return;
+    free(grid->hash->rows);
+    free(grid->hash);
+    grid->hash = NULL;
+}
+
+uint64_t grid_hash(const struct grid *grid) {
+    return grid->hash ? grid->hash->value : 0;
+}
+
+struct cycle_detector *create_cycle_detector(int history) {
+    struct cycle_detector *detector = malloc_hashing(sizeof(struct cycle_detector));
+    detector->history = history < 1 ? 1 : history;
+    detector->hashes = malloc_hashing((size_t)detector->history * sizeof(uint64_t));
+    detector->generations = malloc_hashing((size_t)detector->history * sizeof(uint64_t));
+    detector->count = 0;
+    detector->next = 0;
+    detector->period = 0;
+    detector->first = 0;
+    return detector;
+}
+
+void destroy_cycle_detector(struct cycle_detector *detector) {
+    if (!detector) return;
+    free(detector->hashes);
+    free(detector->generations);
+    free(detector);
+}
+
+// Note the hash of a generation. Returns 1 once it matches one of the last
+// history generations, with the shortest such period in detector->period.
+int observe_generation(struct cycle_detector *detector, uint64_t hash, uint64_t generation) {
+    for (int i = 1; i <= detector->count; i++) {
+        int slot = (detector->next - i + detector->history) % detector->history;
+        if (detector->hashes[slot] == hash) {
+            detector->period = generation - detector->generations[slot];
+            detector->first = detector->generations[slot];
+            return 1;
+        }
+    }
+    detector->hashes[detector->next] = hash;
+    detector->generations[detector->next] = generation;
+    detector->next = (detector->next + 1) % detector->history;
+    if (detector->count < detector->history) {
+        detector->count++;
+    }
+    return 0;
+}
+
+// Whether the grid really comes back to its current cells after period more
+// generations, stepped on a copy. A matching hash alone could be a collision,
+// and jumping ahead on one would label a grid with a generation it is not.
+int confirm_cycle(const struct grid *grid, const struct rule *rule, uint64_t period) {
+    struct grid copy;
+    allocate_grid(&copy, grid->width, grid->height, grid->states, NULL);
+    copy.boundary = grid->boundary;
+    copy.pool = grid->pool;
+    copy.generation = grid->generation;
+    memcpy(current_cells(&copy), current_cells(grid), grid->stride * (size_t)(grid->height + 2));
+
+    for (uint64_t i = 0; i < period; i++) {
+        update_grid_with_rule(&copy, rule);
+    }
+    int same = 1;
+    const uint8_t *cells = current_cells(grid), *later = current_cells(&copy);
+    for (int y = 0; y < grid->height && same; y++) {
+        for (int x = 0; x < grid->width; x++) {
+            if (get_cell(grid, cells, x, y) != get_cell(&copy, later, x, y)) {
+                same = 0;
+                break;
+            }
+        }
+    }
+    copy.pool = NULL;
+    free_grid(&copy);
+    return same;
+}
@@ -0,0 +1,44 @@
+#ifndef CYCLE_H
+#define CYCLE_H
+
+#include "grid.h"
+
+#define HASH_BLOCK_ROWS 16  // Rows stepped before they are hashed, small enough to still be in cache
+
+// Hash of the current generation, kept up to date by update_grid_with_rule.
+// Every row has its own hash, computed right after the row is stepped; the
+// grid's hash combines them. With activity tracking only the rows of tiles
+// that changed are hashed again. Changing cells by other means calls for
+// rehash_grid.
+struct grid_hash {
+    uint64_t *rows;             // Of each row of the current generation
+    uint64_t value;             // Of the whole generation
+};
+
+// Detects a generation repeating one of the last history generations
+struct cycle_detector {
+    uint64_t *hashes;           // Ring of recent generation hashes
+    uint64_t *generations;
+    int history;
+    int count;                  // Ring entries in use
+    int next;                   // Ring entry written next
+    uint64_t period;            // Of the cycle found, 0 while there is none
+    uint64_t first;             // Earliest generation known to be on the cycle
+};
+
+void enable_grid_hashing(struct grid *grid);
+void disable_grid_hashing(struct grid *grid);
+uint64_t grid_hash(const struct grid *grid);
+void rehash_grid(struct grid *grid);
+
+uint64_t hash_grid_row(const struct grid *grid, const uint8_t *cells, int y);
+void hash_grid_rows(struct grid *grid, const uint8_t *cells, int y0, int y1);
+void rehash_changed_rows(struct grid *grid, const uint8_t *cells);
+void finish_grid_hash(struct grid *grid);
+
+struct cycle_detector *create_cycle_detector(int history);
+void destroy_cycle_detector(struct cycle_detector *detector);
+int observe_generation(struct cycle_detector *detector, uint64_t hash, uint64_t generation);
+int confirm_cycle(const struct grid *grid, const struct rule *rule, uint64_t period);
+
+#endif
@@ -0,0 +1,180 @@
+#include "ensemble.h"
+#include "kernel.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// One round of work on the pool: members are claimed from a shared counter
+// so threads that finish small members early simply take more of them
+struct ensemble_job {
+    struct ensemble *ensemble;
+    int generations;            // 0 fills the members from their seeds instead
+    atomic_int next;
+};
+
+static void *malloc_ensemble(size_t size) {
+    void *data = calloc(1, size);
+    if (!data) {
+        fprintf(stderr, "Memory allocation failed for ensemble!\n");
+        exit(1);
+    }
+    return data;
+}
+
+static size_t member_bytes(const struct grid *grid) {
+    size_t bytes = grid->stride * (size_t)(grid->height + 2);
+    return (bytes + GRID_ALIGNMENT - 1) & ~(size_t)(GRID_ALIGNMENT - 1);
+}
+
+static size_t member_cells(const struct grid *grid) {
+    return (size_t)grid->width * (size_t)grid->height;
+}
+
+struct member_size {
+    size_t cells;
+    int member;
+};
+
+// Members with more cells first, then by index
+static int compare_sizes(const void *a, const void *b) {
+    const struct member_size *first = a, *second = b;
+    if (first->cells != second->cells) return first->cells < second->cells ? 1 : -1;
+    return first->member - second->member;
+}
+
+static void run_members(void *arg, int thread, int threads) {
+    (void)thread;
+    (void)threads;
+    struct ensemble_job *job = arg;
+    struct ensemble *ensemble = job->ensemble;
+    int slot;
+    while ((slot = atomic_fetch_add_explicit(&job->next, 1, memory_order_relaxed)) < ensemble->count) {
+        int member = ensemble->order[slot];
+        struct grid *grid = &ensemble->grids[member];
+        if (job->generations == 0) {
+            initialize_random_grid(grid, grid->grid1, ensemble->seeds[member]);
+        }
+        for (int i = 0; i < job->generations; i++) {
+            update_grid_with_rule(grid, ensemble->rules[member]);
+        }
+    }
+}
+
+static void run_ensemble_job(struct ensemble *ensemble, int generations) {
+    struct ensemble_job job;
+    job.ensemble = ensemble;
+    job.generations = generations;
+    atomic_init(&job.next, 0);
+    get_kernel_isa(); // Detected lazily, so settle it before the threads pick kernels
+    if (ensemble->pool && ensemble->pool->threads > 1) {
+        run_on_pool(ensemble->pool, run_members, &job);
+    } else {
+        run_members(&job, 0, 1);
+    }
+}
+
+// Lay out every member in one arena and fill it from its seed. Returns NULL
+// if a member's states do not suit its rule.
+struct ensemble *create_ensemble(const struct ensemble_member *members, int count, struct thread_pool *pool) {
+    struct ensemble *ensemble = malloc_ensemble(sizeof(struct ensemble));
+    ensemble->count = count;
+    ensemble->pool = pool;
+    ensemble->grids = malloc_ensemble((size_t)count * sizeof(struct grid));
+    ensemble->rules = malloc_ensemble((size_t)count * sizeof(const struct rule *));
+    ensemble->seeds = malloc_ensemble((size_t)count * sizeof(uint64_t));
+    ensemble->order = malloc_ensemble((size_t)count * sizeof(int));
+
+    for (int i = 0; i < count; i++) {
+        const struct ensemble_member *member = &members[i];
+        int states = member->rule->states ? member->rule->states : member->states;
+        if ((member->states && states != member->states) || states < 2 || states > MAX_STATES) {
+            fprintf(stderr, "Member %d: %s cannot run with %d states\n", i, member->rule->name, member->states);
+            ensemble->count = 0;
+            destroy_ensemble(ensemble);
+            return NULL;
+        }
+        describe_grid(&ensemble->grids[i], member->width, member->height, states, NULL);
+        ensemble->rules[i] = member->rule;
+        ensemble->seeds[i] = member->seed;
+        ensemble->grids[i].boundary = member->boundary;
+        ensemble->arena_bytes += 2 * member_bytes(&ensemble->grids[i]);
+    }
+
+    ensemble->arena = mallocgrid(ensemble->arena_bytes);
+    uint8_t *cells = ensemble->arena;
+    for (int i = 0; i < count; i++) {
+        struct grid *grid = &ensemble->grids[i];
+        grid->grid1 = cells;
+        cells += member_bytes(grid);
+        grid->grid2 = cells;
+        cells += member_bytes(grid);
+    }
+
+    struct member_size *sizes = malloc_ensemble((size_t)count * sizeof(struct member_size));
+    for (int i = 0; i < count; i++) {
+        sizes[i] = (struct member_size){member_cells(&ensemble->grids[i]), i};
+    }
+    qsort(sizes, (size_t)count, sizeof(struct member_size), compare_sizes);
+    for (int i = 0; i < count; i++) {
+        ensemble->order[i] = sizes[i].member;
+    }
+    free(sizes);
+
+    run_ensemble_job(ensemble, 0);
+    return ensemble;
+}
+
+void destroy_ensemble(struct ensemble *ensemble) {
+    if (!ensemble) return;
+    free_cells(ensemble->arena, ensemble->arena_bytes);
+    free(ensemble->grids);
+    free(ensemble->rules);
+    free(ensemble->seeds);
+    free(ensemble->order);
+    free(ensemble);
+}
+
+// Advance every member by a number of generations
+void step_ensemble(struct ensemble *ensemble, int generations) {
+    if (generations > 0) {
+        run_ensemble_job(ensemble, generations);
+    }
+}
+
+// Cells of a member that are not in state 0
+uint64_t member_population(const struct ensemble *ensemble, int member) {
+    const struct grid *grid = &ensemble->grids[member];
+    const uint8_t *cells = current_cells(grid);
+    uint64_t population = 0;
+    for (int y = 0; y < grid->height; y++) {
+        for (int x = 0; x < grid->width; x++) {
+            population += get_cell(grid, cells, x, y) != 0;
+        }
+    }
+    return population;
+}
+
+// Write one CSV line per member, in member order
+int write_ensemble_results(const struct ensemble *ensemble, const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        fprintf(stderr, "Error opening %s!\n", filename);
+        return -1;
+    }
+    fprintf(file, "member,rule,width,height,states,seed,generation,population,density\n");
+    for (int i = 0; i < ensemble->count; i++) {
+        const struct grid *grid = &ensemble->grids[i];
+        uint64_t population = member_population(ensemble, i);
+        // Larger than Life rules have commas of their own
+        const char *quote = strchr(ensemble->rules[i]->name, ',') ? "\"" : "";
+        fprintf(file, "%d,%s%s%s,%d,%d,%d,%llu,%llu,%llu,%.6f\n", i, quote, ensemble->rules[i]->name, quote,
+                grid->width, grid->height, grid->states, (unsigned long long)ensemble->seeds[i],
+                (unsigned long long)grid->generation, (unsigned long long)population,
+                (double)population / (double)member_cells(grid));
+    }
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Error writing %s!\n", filename);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include <stdio.h>
+#include "grid.h"
+#include "rule.h"
+#include "pool.h"
+
+// Many small independent grids stepped as one batch, for parameter sweeps.
+// Member fields are kept in parallel arrays and every member's cells in one
+// arena, so an ensemble costs one allocation however many members it has.
+// A step hands members out to the threads of the pool one at a time, largest
+// first, and a thread advances the member it took by all the generations
+// while its cells are still in cache.
+
+struct ensemble_member {
+    int width;
+    int height;
+    int states;                 // 0 to take them from the rule
+    int boundary;               // enum boundary_mode
+    const struct rule *rule;    // Must outlive the ensemble
+    uint64_t seed;              // Of the random starting grid
+};
+
+struct ensemble {
+    int count;
+    struct grid *grids;         // Cell buffers point into the arena, palettes are NULL
+    const struct rule **rules;
+    uint64_t *seeds;
+    int *order;                 // Members by decreasing cell count
+    uint8_t *arena;
+    size_t arena_bytes;
+    struct thread_pool *pool;   // NULL steps every member on the calling thread
+};
+
+struct ensemble *create_ensemble(const struct ensemble_member *members, int count, struct thread_pool *pool);
+void destroy_ensemble(struct ensemble *ensemble);
+
+void step_ensemble(struct ensemble *ensemble, int generations);
+
+uint64_t member_population(const struct ensemble *ensemble, int member);
+int write_ensemble_results(const struct ensemble *ensemble, const char *filename);
+
+#endif
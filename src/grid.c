@@ -1,25 +1,32 @@
 #include "grid.h"
+#include "kernel.h"
+#include "pool.h"
+#include "activity.h"
+#include "random.h"
+#include "cycle.h"
+#include "arena.h"
+#include "stats.h"
+#include "neighborhood.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <time.h>
 
-// Function to allocate memory for a 2D grid of cells
-struct cell** mallocgrid(int width, int height) {
-    struct cell** grid = malloc(width * sizeof(struct cell *));
-    if (!grid) {
-        fprintf(stderr, "Memory allocation failed for grid!\n");
-        exit(1);
-    }
-    for (int i = 0; i < width; i++) {
-        grid[i] = malloc(height * sizeof(struct cell));
-        if (!grid[i]) {
-            fprintf(stderr, "Memory allocation failed for grid row %d!\n", i);
-            exit(1);
-        }
-    }
-    return grid;
+// Function to allocate a zeroed, cache-line-aligned cell buffer from the arena
+uint8_t* mallocgrid(size_t size) {
+    return arena_alloc(size);
+}
+
+// Give a buffer from mallocgrid of the same size back to the arena
+void free_cells(uint8_t *cells, size_t size) {
+    arena_free(cells, size);
+}
+
+// Bytes of one of a grid's two buffers, halo rows included
+static size_t buffer_bytes(const struct grid *grid) {
+    size_t bytes = grid->stride * (size_t)(grid->height + 2);
+    return (bytes + GRID_ALIGNMENT - 1) & ~(size_t)(GRID_ALIGNMENT - 1);
 }
 
 // Function to allocate memory for a color palette
@@ -38,13 +45,22 @@ void free_palette(struct color *palette) {
 }
 
 // Free allocated grid memory
-void free_grid(struct grid *grid) {
-    for (int i = 0; i < grid->width; i++) {
-        free(grid->grid1[i]);
-        free(grid->grid2[i]);
+static void free_neighborhood_windows(struct grid *grid) {
+    for (int i = 0; i < grid->window_count; i++) {
+        free_neighborhood_window(&grid->windows[i]);
     }
-    free(grid->grid1);
-    free(grid->grid2);
+    free(grid->windows);
+    grid->windows = NULL;
+    grid->window_count = 0;
+}
+
+void free_grid(struct grid *grid) {
+    disable_activity_tracking(grid);
+    disable_grid_hashing(grid);
+    disable_grid_stats(grid);
+    free_neighborhood_windows(grid);
+    free_cells(grid->temporal_tiles, grid->temporal_bytes);
+    free_cells(grid->grid1, 2 * buffer_bytes(grid));   // grid2 shares its block
     free(grid->palette);
 }
 
@@ -70,110 +86,322 @@ void initialize_gradient_palette(struct color *palette, struct color *start, str
 }
 
 // Initialize a random palette
-void initialize_random_palette(struct color *palette, int total_states) {
-    for (int i = 0; i < total_states; i++) {
-        palette[i].red = rand() % 256;
-        palette[i].green = rand() % 256;
-        palette[i].blue = rand() % 256;
-    }
+void initialize_random_palette(struct color *palette, int total_states, uint64_t seed) {
+    fill_random_palette(palette, total_states, seed);
 }
 
-// Initialize a random grid with given states
-void initialize_random_grid(struct cell **grid, int width, int height, int states) {
-    for (int i = 0; i < width; i++) {
-        for (int j = 0; j < height; j++) {
-            grid[i][j].state = rand() % states;
-        }
-    }
+// Initialize a random grid with given states, the same for a seed whatever the thread count
+void initialize_random_grid(struct grid *grid, uint8_t *cells, uint64_t seed) {
+    fill_random_cells(grid, cells, seed);
 }
 
-// Initialize the grid structure
-void initialize_grid(struct grid *grid, int width, int height, int states, struct color* palette) {
+// Fill in the fields of a grid, leaving its cell buffers to the caller
+void describe_grid(struct grid *grid, int width, int height, int states, struct color* palette) {
+    if (states < 2 || states > MAX_STATES) {
+        fprintf(stderr, "Unsupported number of states: %d (expected 2 to %d)\n", states, MAX_STATES);
+        exit(1);
+    }
+
     grid->width = width;
     grid->height = height;
     grid->current = 0; // Start with grid1
-
-    grid->grid1 = mallocgrid(width, height);
-    grid->grid2 = mallocgrid(width, height);
     grid->states = states;
     grid->palette = palette;
+    grid->pool = NULL;
+    grid->activity = NULL;
+    grid->hash = NULL;
+    grid->stats = NULL;
+    grid->windows = NULL;
+    grid->window_count = 0;
+    grid->temporal_tiles = NULL;
+    grid->temporal_bytes = 0;
+    grid->generation = 0;
+
+    // Two-state grids are bit-packed, everything else uses a byte per cell.
+    // Rows are padded to whole 64-bit words so they can be stepped a word at a time.
+    // Both include the one-cell halo around the grid.
+    grid->format = (states == 2) ? CELL_FORMAT_BITS : CELL_FORMAT_BYTES;
+    grid->boundary = BOUNDARY_DEAD;
+    size_t row_bytes = (grid->format == CELL_FORMAT_BITS) ? ((size_t)width + 2 + 7) / 8 : (size_t)width + 2;
+    grid->stride = (row_bytes + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+    grid->grid1 = NULL;
+    grid->grid2 = NULL;
+}
+
+// Set up a grid with every cell in state 0. Both buffers come from one
+// block, so a grid costs a single arena allocation.
+void allocate_grid(struct grid *grid, int width, int height, int states, struct color* palette) {
+    describe_grid(grid, width, height, states, palette);
+    grid->grid1 = mallocgrid(2 * buffer_bytes(grid));
+    grid->grid2 = grid->grid1 + buffer_bytes(grid);
+}
+
+void initialize_grid(struct grid *grid, int width, int height, int states, struct color* palette, uint64_t seed) {
+    allocate_grid(grid, width, height, states, palette);
 
     // Initialize grid1 with random states
-    initialize_random_grid(grid->grid1, width, height, states);
+    initialize_random_grid(grid, grid->grid1, seed);
+}
+
+
+
+// Fill the left and right halo cells of rows [y0, y1) according to the boundary mode
+void refresh_halo_columns(struct grid *grid, uint8_t *cells, int y0, int y1) {
+    int width = grid->width;
+    int dead = dead_halo_value(grid);
+
+    for (int y = y0; y < y1; y++) {
+        switch (grid->boundary) {
+            case BOUNDARY_TORUS:
+                set_cell(grid, cells, -1, y, get_cell(grid, cells, width - 1, y));
+                set_cell(grid, cells, width, y, get_cell(grid, cells, 0, y));
+                break;
+            case BOUNDARY_REFLECT:
+                set_cell(grid, cells, -1, y, get_cell(grid, cells, 0, y));
+                set_cell(grid, cells, width, y, get_cell(grid, cells, width - 1, y));
+                break;
+            default:
+                set_cell(grid, cells, -1, y, dead);
+                set_cell(grid, cells, width, y, dead);
+                break;
+        }
+    }
 }
 
+// Fill the halo around a cell buffer according to the grid's boundary mode
+void refresh_halo(struct grid *grid, uint8_t *cells) {
+    int height = grid->height;
+    int dead = dead_halo_value(grid);
 
+    // Left and right columns first, so the row copies below also fill the corners
+    refresh_halo_columns(grid, cells, 0, height);
+
+    switch (grid->boundary) {
+        case BOUNDARY_TORUS:
+            memcpy(grid_row(grid, cells, -1), grid_row(grid, cells, height - 1), grid->stride);
+            memcpy(grid_row(grid, cells, height), grid_row(grid, cells, 0), grid->stride);
+            break;
+        case BOUNDARY_REFLECT:
+            memcpy(grid_row(grid, cells, -1), grid_row(grid, cells, 0), grid->stride);
+            memcpy(grid_row(grid, cells, height), grid_row(grid, cells, height - 1), grid->stride);
+            break;
+        default:
+            memset(grid_row(grid, cells, -1), dead, grid->stride);
+            memset(grid_row(grid, cells, height), dead, grid->stride);
+            break;
+    }
+}
 
-// Count live neighbors of a cell
-int count_live_neighbors(int x, int y, struct cell **grid, struct grid *grid_info) {
+// Count live (state 1) neighbors of a cell, halo cells included
+int count_live_neighbors(int x, int y, const uint8_t *cells, struct grid *grid_info) {
     int live_neighbors = 0;
-    for (int dx = -1; dx <= 1; dx++) {
-        for (int dy = -1; dy <= 1; dy++) {
-            if ((dx || dy) && x + dx >= 0 && x + dx < grid_info->width && y + dy >= 0 && y + dy < grid_info->height) {
-                live_neighbors += grid[x + dx][y + dy].state;
-            }
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            live_neighbors += (get_cell(grid_info, cells, x + dx, y + dy) == 1);
         }
     }
-    return live_neighbors;
+    return live_neighbors - (get_cell(grid_info, cells, x, y) == 1);
 }
 
 // Check if a cell has a successor in the next generation
-int has_successor(int x, int y, struct cell **grid, struct grid *grid_info) {
-    int target_state = (grid[x][y].state + 1) % grid_info->states;
-    for (int dx = -1; dx <= 1; dx++) {
-        for (int dy = -1; dy <= 1; dy++) {
-            if ((dx || dy) && x + dx >= 0 && x + dx < grid_info->width && y + dy >= 0 && y + dy < grid_info->height) {
-                if (grid[x + dx][y + dy].state == target_state) return 1;
+int has_successor(int x, int y, const uint8_t *cells, struct grid *grid_info) {
+    // The cell itself never equals its own successor, so it can stay in the sweep
+    int target_state = (get_cell(grid_info, cells, x, y) + 1) % grid_info->states;
+    int dead = (grid_info->boundary == BOUNDARY_DEAD);
+    int found = 0;
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            // A dead halo is state 0 on bit grids, which is no neighbor at all
+            if (dead && (x + dx < 0 || x + dx >= grid_info->width || y + dy < 0 || y + dy >= grid_info->height)) {
+                continue;
             }
+            found |= (get_cell(grid_info, cells, x + dx, y + dy) == target_state);
         }
     }
-    return 0;
+    return found;
 }
 
 // Update the grid based on the specified rule function
-void update_grid(struct grid *grid, int (*rule_function)(int, int, struct cell **, struct grid *)) {
-    struct cell **grid_current = (grid->current == 0) ? grid->grid1 : grid->grid2;
-    struct cell **grid_next = (grid->current == 0) ? grid->grid2 : grid->grid1;
-
-    for (int x = 0; x < grid->width; x++) {
-        for (int y = 0; y < grid->height; y++) {
-            grid_next[x][y].state = rule_function(x, y, grid_current, grid);
-        }
+void update_grid(struct grid *grid, int (*rule_function)(int, int, const uint8_t *, struct grid *)) {
+    // Built-in rules run through a specialized kernel, picked once per generation
+    const struct rule *rule = builtin_rule(rule_function);
+    if (rule) {
+        update_grid_with_rule(grid, rule);
+    } else {
+        update_grid_per_cell(grid, rule_function);
     }
+}
 
-    grid->current = 1 - grid->current; // Toggle between 0 and 1
+// One generation of work shared by the threads of a pool
+struct step_job {
+    struct grid *grid;
+    const struct rule *rule;
+    step_kernel kernel;
+    counting_kernel counter;                // Steps and counts statistics in one sweep, else NULL
+    const uint8_t *cells;
+    uint8_t *next;
+    struct neighborhood_window *windows;    // One per thread for the neighborhood kernel, else NULL
+};
+
+// Step rows [y0, y1) of a band; the neighborhood kernel slides its window on
+// from the rows before instead of building it again
+static int step_rows(struct step_job *job, int thread, int y0, int y1) {
+    if (job->windows) {
+        return step_neighborhood_window(&job->windows[thread], job->grid, job->rule, job->cells, job->next,
+                                        0, job->grid->width, y0, y1);
+    }
+    if (job->counter) {
+        return job->counter(job->grid, job->rule, job->cells, job->next, 0, job->grid->width, y0, y1,
+                            &job->grid->stats->partials[thread]);
+    }
+    return job->kernel(job->grid, job->rule, job->cells, job->next, 0, job->grid->width, y0, y1);
 }
 
-// Rules for the cellular automaton
-int conways_game_of_life_rule(int x, int y, struct cell **grid, struct grid *grid_info) {
-    int live_neighbors = count_live_neighbors(x, y, grid, grid_info);
-    return (grid[x][y].state == 1) ? (live_neighbors == 2 || live_neighbors == 3) : (live_neighbors == 3);
+// First row of the band a thread steps. Bands only depend on the thread
+// count, and every cell is computed the same way whichever band it is in.
+static int band_start(int height, int thread, int threads) {
+    return (int)((long long)height * thread / threads);
 }
 
-int highlife_rule(int x, int y, struct cell **grid, struct grid *grid_info) {
-    int live_neighbors = count_live_neighbors(x, y, grid, grid_info);
-    return (grid[x][y].state == 1) ? (live_neighbors == 1 || live_neighbors == 3 || live_neighbors == 5) : (live_neighbors == 3);
+static void step_band(void *arg, int thread, int threads) {
+    struct step_job *job = arg;
+    int y0 = band_start(job->grid->height, thread, threads);
+    int y1 = band_start(job->grid->height, thread + 1, threads);
+    int count = job->grid->stats && !job->counter;
+    if (y0 < y1 && (job->grid->hash || count)) {
+        // Hash and count every few rows right after stepping them, while they are still in cache
+        for (int y = y0; y < y1; y += HASH_BLOCK_ROWS) {
+            int end = (y1 - y < HASH_BLOCK_ROWS) ? y1 : y + HASH_BLOCK_ROWS;
+            step_rows(job, thread, y, end);
+            if (job->grid->hash) {
+                hash_grid_rows(job->grid, job->next, y, end);
+            }
+            if (count) {
+                count_stats_rows(job->grid, job->cells, job->next, y, end, thread);
+            }
+        }
+    } else if (y0 < y1) {
+        step_rows(job, thread, y0, y1);
+    }
 }
 
-int cyclic_rule(int x, int y, struct cell **grid, struct grid *grid_info) {
-    return has_successor(x, y, grid, grid_info) ? (grid[x][y].state + 1) % grid_info->states : grid[x][y].state;
+// The grid's neighborhood windows, one per thread. They are kept between
+// generations so their rows of sums are only allocated again when a rule of
+// larger radius or a different thread count needs them; the sums themselves
+// are of the last generation and built afresh.
+static struct neighborhood_window *neighborhood_windows(struct grid *grid, int count) {
+    if (grid->window_count != count) {
+        free_neighborhood_windows(grid);
+        grid->windows = calloc((size_t)count, sizeof(struct neighborhood_window));
+        if (!grid->windows) {
+            fprintf(stderr, "Memory allocation failed for neighborhood window!\n");
+            exit(1);
+        }
+        grid->window_count = count;
+    }
+    for (int i = 0; i < count; i++) {
+        grid->windows[i].cells = NULL;
+    }
+    return grid->windows;
 }
 
-// Draw a single cell using its color from the palette
-void draw_cell(int x, int y, struct cell *cell, struct color *palette) {
-    struct color col = palette[cell->state];
-    SDL_SetRenderDrawColor(renderer, col.red, col.green, col.blue, 255);
-    draw_rectangle(x * CELL_SIZE, y * CELL_SIZE, CELL_SIZE, CELL_SIZE);
+// Update the grid based on a parsed rule
+void update_grid_with_rule(struct grid *grid, const struct rule *rule) {
+    struct step_job job = {grid, rule, select_kernel(grid, rule), NULL, current_cells(grid), next_cells(grid), NULL};
+    int threads = (grid->pool && grid->pool->threads > 1 && !grid->activity) ? grid->pool->threads : 1;
+    if (grid->stats) {
+        begin_grid_stats(grid, threads);
+        // Only the changed tiles are stepped with activity tracking, and they are counted apart
+        if (!grid->activity) {
+            job.counter = select_counting_kernel(grid, rule);
+        }
+    }
+    int pool_threads = grid->pool ? grid->pool->threads : 1;
+    if (job.kernel == neighborhood_kernel) {
+        job.windows = neighborhood_windows(grid, pool_threads);
+    }
+
+    refresh_halo(grid, current_cells(grid));
+    if (grid->activity) {
+        step_active_tiles(grid, rule, job.kernel, job.windows);
+        if (grid->hash) {
+            rehash_changed_rows(grid, job.next);
+        }
+        if (grid->stats) {
+            count_changed_tiles(grid, job.cells, job.next);
+        }
+    } else if (grid->pool && grid->pool->threads > 1) {
+        run_on_pool(grid->pool, step_band, &job); // Returns once every band is done
+    } else {
+        step_band(&job, 0, 1);
+    }
+
+    grid->current = 1 - grid->current; // Toggle between 0 and 1
+    grid->generation++;
+    if (grid->hash) {
+        finish_grid_hash(grid);
+    }
+    if (grid->stats) {
+        finish_grid_stats(grid, threads, grid->activity != NULL || job.counter != NULL);
+    }
 }
 
-// Draw the entire grid
-void draw_grid(struct grid *grid) {
-    struct cell **grid_current = (grid->current == 0) ? grid->grid1 : grid->grid2;
-    for (int i = 0; i < grid->width; i++) {
-        for (int j = 0; j < grid->height; j++) {
-            draw_cell(i, j, &grid_current[i][j], grid->palette);
+// Update the grid by calling the rule function for every cell
+void update_grid_per_cell(struct grid *grid, int (*rule_function)(int, int, const uint8_t *, struct grid *)) {
+    uint8_t *grid_current = current_cells(grid);
+    uint8_t *grid_next = next_cells(grid);
+
+    refresh_halo(grid, grid_current);
+    if (grid->stats) {
+        begin_grid_stats(grid, 1);
+    }
+
+    // Built-in life-like rules are looked up once here instead of in every cell's callback
+    const struct rule *table = builtin_rule(rule_function);
+    if (table && table->kind != RULE_LIFE_LIKE) {
+        table = NULL;
+    }
+
+    // Row-major sweep so consecutive cells are adjacent in memory
+    for (int y = 0; y < grid->height; y++) {
+        for (int x = 0; x < grid->width; x++) {
+            int next;
+            if (table) {
+                int live = count_live_neighbors(x, y, grid_current, grid);
+                next = table->table[get_cell(grid, grid_current, x, y)][live];
+            } else {
+                next = rule_function(x, y, grid_current, grid);
+            }
+            set_cell(grid, grid_next, x, y, next);
         }
     }
+    if (grid->stats) {
+        count_stats_rows(grid, grid_current, grid_next, 0, grid->height, 0);
+    }
+
+    grid->current = 1 - grid->current; // Toggle between 0 and 1
+    grid->generation++;
+    mark_all_changed(grid);
+    rehash_grid(grid);
+    if (grid->stats) {
+        finish_grid_stats(grid, 1, 0);
+    }
+}
+
+// Rules for the cellular automaton, looked up in the built-in transition tables
+int conways_game_of_life_rule(int x, int y, const uint8_t *cells, struct grid *grid_info) {
+    const struct rule *rule = builtin_rule(conways_game_of_life_rule);
+    return rule->table[get_cell(grid_info, cells, x, y)][count_live_neighbors(x, y, cells, grid_info)];
+}
+
+int highlife_rule(int x, int y, const uint8_t *cells, struct grid *grid_info) {
+    const struct rule *rule = builtin_rule(highlife_rule);
+    return rule->table[get_cell(grid_info, cells, x, y)][count_live_neighbors(x, y, cells, grid_info)];
+}
+
+int cyclic_rule(int x, int y, const uint8_t *cells, struct grid *grid_info) {
+    int state = get_cell(grid_info, cells, x, y);
+    return has_successor(x, y, cells, grid_info) ? (state + 1) % grid_info->states : state;
 }
 
 // Write the grid's state to a file
@@ -184,11 +412,12 @@ void write_grid_to_file(struct grid *grid, const char* filename) {
         exit(1);
     }
 
+    // One line per column, as in the original text dump
     fprintf(file, "%d %d\n", grid->width, grid->height);
-    struct cell **grid_current = (grid->current == 0) ? grid->grid1 : grid->grid2;
+    const uint8_t *grid_current = current_cells(grid);
     for (int i = 0; i < grid->width; i++) {
         for (int j = 0; j < grid->height; j++) {
-            fprintf(file, "%d ", grid_current[i][j].state);
+            fprintf(file, "%d ", get_cell(grid, grid_current, i, j));
         }
         fprintf(file, "\n");
     }
@@ -1,52 +1,141 @@
 #ifndef GRID_H
 #define GRID_H
 
-#include "gui.h" 
+#include <stdint.h>
+#include <stddef.h>
 
 
-#define CELL_SIZE 2         
+#define CELL_SIZE 2
+#define MAX_STATES 255      // Cells are stored in one byte, 0xFF is reserved
+#define CELL_VOID 0xFF      // Halo value of a dead boundary on byte grids
+#define GRID_ALIGNMENT 64   // Cell buffers start on a cache line
 
-struct cell {
-    int state; 
+// Storage format of the cells, picked from the number of states
+enum cell_format {
+    CELL_FORMAT_BITS,   // 2 states, 64 cells packed per uint64_t word
+    CELL_FORMAT_BYTES   // Up to MAX_STATES states, one uint8_t per cell
 };
 
+// What the cells just outside the grid look like
+enum boundary_mode {
+    BOUNDARY_DEAD,      // Outside cells never count as neighbors
+    BOUNDARY_TORUS,     // Opposite edges wrap around
+    BOUNDARY_REFLECT    // Edge cells are mirrored into the halo
+};
+
+struct rule;
+struct thread_pool;
+struct activity;
+struct grid_hash;
+struct grid_stats;
+struct neighborhood_window;
+
+// Cell buffers are padded with a one-cell halo on every side: cell (x, y) is
+// stored at padded position (x + 1, y + 1), so x and y may range from -1 to
+// width and height. The halo is refreshed once per generation from the
+// boundary mode, which lets the stepping loop read neighbors without bounds checks.
 struct grid {
-    struct cell **grid1; 
-    struct cell **grid2; 
-    int current;        
-    int width;        
-    int height;         
-    struct color *palette; 
-    int states; 
+    uint8_t *grid1;     // Row-major cell buffer, stride bytes per padded row
+    uint8_t *grid2;
+    int current;
+    int width;
+    int height;
+    int format;         // enum cell_format
+    int boundary;       // enum boundary_mode
+    size_t stride;      // Bytes per padded row, a multiple of sizeof(uint64_t)
+    struct color *palette;
+    int states;
+    struct thread_pool *pool;   // Steps row bands in parallel when set, NULL steps serially
+    struct activity *activity;  // Changed-tile tracking, NULL recomputes every cell
+    struct grid_hash *hash;     // Hash of the current generation, NULL when not hashing
+    struct grid_stats *stats;   // Population, births and deaths, NULL when not counting
+    struct neighborhood_window *windows;    // Neighborhood kernel scratch, one per thread, NULL until used
+    int window_count;
+    uint8_t *temporal_tiles;    // Temporal blocking scratch, two tiles per thread, NULL until used
+    size_t temporal_bytes;
+    uint64_t generation;        // Generations stepped since the grid was created or loaded
 };
 
 struct color {
-    int red;  
-    int green; 
-    int blue;  
+    int red;
+    int green;
+    int blue;
 };
 
-struct cell** mallocgrid(int width, int height);
+// Buffer holding the current generation
+static inline uint8_t *current_cells(const struct grid *grid) {
+    return (grid->current == 0) ? grid->grid1 : grid->grid2;
+}
+
+// Buffer the next generation is written to
+static inline uint8_t *next_cells(const struct grid *grid) {
+    return (grid->current == 0) ? grid->grid2 : grid->grid1;
+}
+
+// Start of padded row y (-1 to height) of a cell buffer
+static inline uint8_t *grid_row(const struct grid *grid, const uint8_t *cells, int y) {
+    return (uint8_t *)cells + (size_t)(y + 1) * grid->stride;
+}
+
+// Read the state of cell (x, y) from a cell buffer of the grid
+static inline int get_cell(const struct grid *grid, const uint8_t *cells, int x, int y) {
+    const uint8_t *row = grid_row(grid, cells, y);
+    x++;
+    if (grid->format == CELL_FORMAT_BITS) {
+        return (int)((((const uint64_t *)row)[x >> 6] >> (x & 63)) & 1);
+    }
+    return row[x];
+}
+
+// Write the state of cell (x, y) into a cell buffer of the grid
+static inline void set_cell(const struct grid *grid, uint8_t *cells, int x, int y, int state) {
+    uint8_t *row = grid_row(grid, cells, y);
+    x++;
+    if (grid->format == CELL_FORMAT_BITS) {
+        uint64_t *word = &((uint64_t *)row)[x >> 6];
+        uint64_t mask = (uint64_t)1 << (x & 63);
+        *word = state ? (*word | mask) : (*word & ~mask);
+    } else {
+        row[x] = (uint8_t)state;
+    }
+}
+
+// Halo value of a dead boundary. On bit grids that is simply state 0, which
+// the cyclic rule has to skip itself; byte grids use a value no state or
+// successor can take so the cyclic rule ignores it as well.
+static inline int dead_halo_value(const struct grid *grid) {
+    return (grid->format == CELL_FORMAT_BITS) ? 0 : CELL_VOID;
+}
+
+uint8_t* mallocgrid(size_t size);
+void free_cells(uint8_t *cells, size_t size);
 struct color* mallocpalette(int total_states);
 void free_palette(struct color *palette);
 void free_grid(struct grid *grid);
 
 void initialize_black_and_white_palette(struct color *palette);
 void initialize_gradient_palette(struct color *palette, struct color *start, struct color *end, int total_states);
-void initialize_random_palette(struct color *palette, int total_states);
-void initialize_random_grid(struct cell **grid, int width, int height, int states);
-void initialize_grid(struct grid *grid, int width, int height, int states, struct color* palette);
+void initialize_random_palette(struct color *palette, int total_states, uint64_t seed);
+void initialize_random_grid(struct grid *grid, uint8_t *cells, uint64_t seed);
+void describe_grid(struct grid *grid, int width, int height, int states, struct color* palette);
+void allocate_grid(struct grid *grid, int width, int height, int states, struct color* palette);
+void initialize_grid(struct grid *grid, int width, int height, int states, struct color* palette, uint64_t seed);
+
+void refresh_halo(struct grid *grid, uint8_t *cells);
+void refresh_halo_columns(struct grid *grid, uint8_t *cells, int y0, int y1);
 
-int count_live_neighbors(int x, int y, struct cell **grid, struct grid *grid_info);
-int has_successor(int x, int y, struct cell **grid, struct grid *grid_info);
+int count_live_neighbors(int x, int y, const uint8_t *cells, struct grid *grid_info);
+int has_successor(int x, int y, const uint8_t *cells, struct grid *grid_info);
 
-void update_grid(struct grid *grid, int (*rule_function)(int, int, struct cell **, struct grid *));
+void update_grid(struct grid *grid, int (*rule_function)(int, int, const uint8_t *, struct grid *));
+void update_grid_with_rule(struct grid *grid, const struct rule *rule);
+void update_grid_generations(struct grid *grid, const struct rule *rule, int generations);
+void update_grid_blocked(struct grid *grid, const struct rule *rule, int generations);
+void update_grid_per_cell(struct grid *grid, int (*rule_function)(int, int, const uint8_t *, struct grid *));
 
-int conways_game_of_life_rule(int x, int y, struct cell **grid, struct grid *grid_info);
-int highlife_rule(int x, int y, struct cell **grid, struct grid *grid_info);
-int cyclic_rule(int x, int y, struct cell **grid, struct grid *grid_info);
+int conways_game_of_life_rule(int x, int y, const uint8_t *cells, struct grid *grid_info);
+int highlife_rule(int x, int y, const uint8_t *cells, struct grid *grid_info);
+int cyclic_rule(int x, int y, const uint8_t *cells, struct grid *grid_info);
 
-void draw_cell(int x, int y, struct cell *cell, struct color *palette);
-void draw_grid(struct grid *grid);
 void write_grid_to_file(struct grid *grid, const char* filename);
-#endif 
+#endif
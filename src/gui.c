@@ -5,7 +5,7 @@
 #include "gui.h"
 
 
-SDL_Renderer *renderer;
+SDL_Renderer *renderer = NULL;
 static SDL_Window *window;
 
 static const Uint8 *keyboard_state = NULL; // Current keyboard state
@@ -14,6 +14,7 @@ static Uint8 previous_keyboard_state[SDL_NUM_SCANCODES]; // Previous keyboard st
 int mouse_location[2] = {0, 0};
 int mouse_clicked = 0;
 int should_continue = 1;
+int show_overlay = 0; // Performance overlay, toggled with F3
 
 // Initialize keyboard state (call this function once at the start of the program)
 void initialize_keyboard_state() {
@@ -62,6 +63,11 @@ void handle_events() {
             case SDL_MOUSEBUTTONUP:
                 mouse_clicked = 0;
                 break;
+            case SDL_KEYDOWN:
+                if (event.key.keysym.scancode == SDL_SCANCODE_F3 && !event.key.repeat) {
+                    show_overlay = !show_overlay;
+                }
+                break;
             default:
                 break;
         }
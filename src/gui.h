@@ -6,11 +6,12 @@
 #include <string.h> // Include for memcpy
 
 
-SDL_Renderer *renderer;
+extern SDL_Renderer *renderer;
 
-int mouse_location[2];
-int mouse_clicked;
-int should_continue;
+extern int mouse_location[2];
+extern int mouse_clicked;
+extern int should_continue;
+extern int show_overlay;
 
 
 void initialize_keyboard_state();
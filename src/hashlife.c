@@ -0,0 +1,500 @@
+#include "hashlife.h"
+#include "activity.h"
+#include "cycle.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HL_BLOCK_NODES 4096
+#define HL_MAX_LEVEL 60         // Keeps world coordinates well inside int64_t
+
+struct hl_block {
+    struct hl_block *next;
+    size_t used;
+    struct hl_node nodes[HL_BLOCK_NODES];
+};
+
+// A node's center after 2^step generations, for steps short of level - 2
+struct hl_memo {
+    struct hl_node *node;
+    struct hl_node *result;
+    struct hl_memo *next;
+    int step;
+};
+
+struct hl_memo_block {
+    struct hl_memo_block *next;
+    size_t used;
+    struct hl_memo entries[HL_BLOCK_NODES];
+};
+
+static void *malloc_hashlife(size_t size) {
+    void *data = calloc(1, size);
+    if (!data) {
+        fprintf(stderr, "Memory allocation failed for hashlife!\n");
+        exit(1);
+    }
+    return data;
+}
+
+static struct hl_node *alloc_node(struct hashlife *hashlife) {
+    if (hashlife->free_nodes) {
+        struct hl_node *node = hashlife->free_nodes;
+        hashlife->free_nodes = node->next;
+        *node = (struct hl_node){0};
+        return node;
+    }
+    if (!hashlife->blocks || hashlife->blocks->used == HL_BLOCK_NODES) {
+        struct hl_block *block = malloc_hashlife(sizeof(struct hl_block));
+        block->next = hashlife->blocks;
+        hashlife->blocks = block;
+    }
+    return &hashlife->blocks->nodes[hashlife->blocks->used++];
+}
+
+static size_t hash_children(const struct hl_node *nw, const struct hl_node *ne,
+                            const struct hl_node *sw, const struct hl_node *se) {
+    uint64_t h = (uint64_t)(uintptr_t)nw * 0x9E3779B97F4A7C15ull;
+    h = (h ^ (uint64_t)(uintptr_t)ne) * 0xC2B2AE3D27D4EB4Full;
+    h = (h ^ (uint64_t)(uintptr_t)sw) * 0x165667B19E3779F9ull;
+    h = (h ^ (uint64_t)(uintptr_t)se) * 0x27D4EB2F165667C5ull;
+    return (size_t)(h ^ (h >> 29));
+}
+
+// Double the hash table once it holds more nodes than buckets
+static void grow_buckets(struct hashlife *hashlife) {
+    size_t count = hashlife->bucket_count * 2;
+    struct hl_node **buckets = malloc_hashlife(count * sizeof(struct hl_node *));
+
+    for (size_t i = 0; i < hashlife->bucket_count; i++) {
+        struct hl_node *node = hashlife->buckets[i];
+        while (node) {
+            struct hl_node *next = node->next;
+            size_t slot = hash_children(node->nw, node->ne, node->sw, node->se) & (count - 1);
+            node->next = buckets[slot];
+            buckets[slot] = node;
+            node = next;
+        }
+    }
+    free(hashlife->buckets);
+    hashlife->buckets = buckets;
+    hashlife->bucket_count = count;
+}
+
+// The unique node with these quadrants
+static struct hl_node *join(struct hashlife *hashlife, struct hl_node *nw, struct hl_node *ne,
+                            struct hl_node *sw, struct hl_node *se) {
+    size_t slot = hash_children(nw, ne, sw, se) & (hashlife->bucket_count - 1);
+    for (struct hl_node *node = hashlife->buckets[slot]; node; node = node->next) {
+        if (node->nw == nw && node->ne == ne && node->sw == sw && node->se == se) return node;
+    }
+
+    struct hl_node *node = alloc_node(hashlife);
+    node->nw = nw;
+    node->ne = ne;
+    node->sw = sw;
+    node->se = se;
+    node->level = nw->level + 1;
+    node->population = nw->population + ne->population + sw->population + se->population;
+    node->next = hashlife->buckets[slot];
+    hashlife->buckets[slot] = node;
+
+    if (++hashlife->node_count > hashlife->bucket_count) {
+        grow_buckets(hashlife);
+    }
+    return node;
+}
+
+static struct hl_node *cell_node(struct hashlife *hashlife, int alive) {
+    return alive ? hashlife->empty[0] + 1 : hashlife->empty[0];
+}
+
+static struct hl_node *empty_node(struct hashlife *hashlife, int level) {
+    if (!hashlife->empty[level]) {
+        struct hl_node *quadrant = empty_node(hashlife, level - 1);
+        hashlife->empty[level] = join(hashlife, quadrant, quadrant, quadrant, quadrant);
+    }
+    return hashlife->empty[level];
+}
+
+// Start an engine for a two-state life-like rule, or return NULL if the rule
+// cannot be run this way. Rules with B0 are refused, since they would turn
+// the infinite empty world alive.
+struct hashlife *create_hashlife(const struct rule *rule) {
+    if (rule->kind != RULE_LIFE_LIKE || rule->states != 2 || rule->table[0][0] == 1
+        || rule->neighborhood.kind != NEIGHBORHOOD_MOORE) {
+        fprintf(stderr, "Hashlife needs a two-state Moore life-like rule without B0: %s\n", rule->name);
+        return NULL;
+    }
+
+    struct hashlife *hashlife = malloc_hashlife(sizeof(struct hashlife));
+    for (int n = 0; n < NEIGHBOR_COUNTS; n++) {
+        if (rule->table[0][n] == 1) hashlife->born |= (uint16_t)(1 << n);
+        if (rule->table[1][n] == 1) hashlife->kept |= (uint16_t)(1 << n);
+    }
+    hashlife->bucket_count = 1 << 16;
+    hashlife->buckets = malloc_hashlife(hashlife->bucket_count * sizeof(struct hl_node *));
+    hashlife->memo_bucket_count = 1 << 12;
+    hashlife->memo_buckets = malloc_hashlife(hashlife->memo_bucket_count * sizeof(struct hl_memo *));
+    hashlife->node_budget = HL_NODE_BUDGET;
+    hashlife->collect_at = HL_NODE_BUDGET;
+
+    // The two cells are a pair of consecutive nodes outside the hash table
+    struct hl_node *cells = alloc_node(hashlife);
+    alloc_node(hashlife);
+    cells[1].population = 1;
+    hashlife->empty[0] = cells;
+
+    hashlife->root = empty_node(hashlife, 3);
+    return hashlife;
+}
+
+// Forget every memoized center of a shorter step
+static void clear_memo(struct hashlife *hashlife) {
+    struct hl_memo_block *block = hashlife->memo_blocks;
+    while (block) {
+        struct hl_memo_block *next = block->next;
+        free(block);
+        block = next;
+    }
+    hashlife->memo_blocks = NULL;
+    memset(hashlife->memo_buckets, 0, hashlife->memo_bucket_count * sizeof(struct hl_memo *));
+    hashlife->memo_count = 0;
+}
+
+void destroy_hashlife(struct hashlife *hashlife) {
+    if (!hashlife) return;
+
+    struct hl_block *block = hashlife->blocks;
+    while (block) {
+        struct hl_block *next = block->next;
+        free(block);
+        block = next;
+    }
+    clear_memo(hashlife);
+    free(hashlife->buckets);
+    free(hashlife->memo_buckets);
+    free(hashlife);
+}
+
+// Build the node of a level covering cells (x, y) to (x + 2^level, y + 2^level)
+// of the grid; everything outside the grid is dead
+static struct hl_node *build_from_grid(struct hashlife *hashlife, struct grid *grid, const uint8_t *cells,
+                                       int level, int64_t x, int64_t y) {
+    if (x >= grid->width || y >= grid->height) {
+        return empty_node(hashlife, level);
+    }
+    if (level == 0) {
+        return cell_node(hashlife, get_cell(grid, cells, (int)x, (int)y) == 1);
+    }
+    int64_t half = (int64_t)1 << (level - 1);
+    return join(hashlife,
+                build_from_grid(hashlife, grid, cells, level - 1, x, y),
+                build_from_grid(hashlife, grid, cells, level - 1, x + half, y),
+                build_from_grid(hashlife, grid, cells, level - 1, x, y + half),
+                build_from_grid(hashlife, grid, cells, level - 1, x + half, y + half));
+}
+
+// Replace the world with the current generation of a dense grid, with the
+// grid's top-left cell at world coordinate (0, 0)
+void hashlife_import(struct hashlife *hashlife, struct grid *grid) {
+    int level = 3;
+    while (((int64_t)1 << level) < grid->width || ((int64_t)1 << level) < grid->height) {
+        level++;
+    }
+    hashlife->root = build_from_grid(hashlife, grid, current_cells(grid), level, 0, 0);
+    hashlife->origin_x = 0;
+    hashlife->origin_y = 0;
+    hashlife->generation = grid->generation;
+}
+
+// Write the world cells at (x, y) offset by the node's position into the grid
+static void export_node(struct hl_node *node, int64_t x, int64_t y, struct grid *grid, uint8_t *cells) {
+    int64_t size = (int64_t)1 << node->level;
+    if (node->population == 0 || x >= grid->width || y >= grid->height || x + size <= 0 || y + size <= 0) {
+        return;
+    }
+    if (node->level == 0) {
+        set_cell(grid, cells, (int)x, (int)y, 1);
+        return;
+    }
+    int64_t half = size / 2;
+    export_node(node->nw, x, y, grid, cells);
+    export_node(node->ne, x + half, y, grid, cells);
+    export_node(node->sw, x, y + half, grid, cells);
+    export_node(node->se, x + half, y + half, grid, cells);
+}
+
+// Copy the world window [0, width) x [0, height) into the grid's current
+// generation. Live cells outside the window are not represented.
+void hashlife_export(struct hashlife *hashlife, struct grid *grid) {
+    uint8_t *cells = current_cells(grid);
+    for (int y = 0; y < grid->height; y++) {
+        for (int x = 0; x < grid->width; x++) {
+            set_cell(grid, cells, x, y, 0);
+        }
+    }
+    export_node(hashlife->root, hashlife->origin_x, hashlife->origin_y, grid, cells);
+    grid->generation = hashlife->generation;
+    mark_all_changed(grid);
+    rehash_grid(grid);
+    recount_grid_stats(grid);
+}
+
+int hashlife_get_cell(struct hashlife *hashlife, int64_t x, int64_t y) {
+    struct hl_node *node = hashlife->root;
+    x -= hashlife->origin_x;
+    y -= hashlife->origin_y;
+    if (x < 0 || y < 0 || x >= ((int64_t)1 << node->level) || y >= ((int64_t)1 << node->level)) {
+        return 0;
+    }
+    while (node->level > 0 && node->population > 0) {
+        int64_t half = (int64_t)1 << (node->level - 1);
+        int east = x >= half, south = y >= half;
+        node = south ? (east ? node->se : node->sw) : (east ? node->ne : node->nw);
+        x -= east ? half : 0;
+        y -= south ? half : 0;
+    }
+    return (int)node->population;
+}
+
+uint64_t hashlife_population(const struct hashlife *hashlife) {
+    return hashlife->root->population;
+}
+
+size_t hashlife_node_count(const struct hashlife *hashlife) {
+    return hashlife->node_count;
+}
+
+static size_t hash_memo(const struct hl_node *node, int step) {
+    uint64_t h = ((uint64_t)(uintptr_t)node ^ (uint64_t)step) * 0x9E3779B97F4A7C15ull;
+    return (size_t)(h ^ (h >> 29));
+}
+
+static struct hl_node *find_memo(struct hashlife *hashlife, const struct hl_node *node, int step) {
+    size_t slot = hash_memo(node, step) & (hashlife->memo_bucket_count - 1);
+    for (struct hl_memo *entry = hashlife->memo_buckets[slot]; entry; entry = entry->next) {
+        if (entry->node == node && entry->step == step) return entry->result;
+    }
+    return NULL;
+}
+
+static void add_memo(struct hashlife *hashlife, struct hl_node *node, int step, struct hl_node *result) {
+    if (hashlife->memo_count >= hashlife->memo_bucket_count) {
+        size_t count = hashlife->memo_bucket_count * 2;
+        struct hl_memo **buckets = malloc_hashlife(count * sizeof(struct hl_memo *));
+        for (size_t i = 0; i < hashlife->memo_bucket_count; i++) {
+            struct hl_memo *entry = hashlife->memo_buckets[i];
+            while (entry) {
+                struct hl_memo *next = entry->next;
+                size_t slot = hash_memo(entry->node, entry->step) & (count - 1);
+                entry->next = buckets[slot];
+                buckets[slot] = entry;
+                entry = next;
+            }
+        }
+        free(hashlife->memo_buckets);
+        hashlife->memo_buckets = buckets;
+        hashlife->memo_bucket_count = count;
+    }
+    if (!hashlife->memo_blocks || hashlife->memo_blocks->used == HL_BLOCK_NODES) {
+        struct hl_memo_block *block = malloc_hashlife(sizeof(struct hl_memo_block));
+        block->next = hashlife->memo_blocks;
+        hashlife->memo_blocks = block;
+    }
+
+    struct hl_memo *entry = &hashlife->memo_blocks->entries[hashlife->memo_blocks->used++];
+    size_t slot = hash_memo(node, step) & (hashlife->memo_bucket_count - 1);
+    *entry = (struct hl_memo){node, result, hashlife->memo_buckets[slot], step};
+    hashlife->memo_buckets[slot] = entry;
+    hashlife->memo_count++;
+}
+
+// Center 2x2 of a 4x4 node after one generation, straight from the rule
+static struct hl_node *step_level2(struct hashlife *hashlife, struct hl_node *node) {
+    int cells[4][4];
+    struct hl_node *quadrants[4] = {node->nw, node->ne, node->sw, node->se};
+    for (int q = 0; q < 4; q++) {
+        int qx = (q & 1) * 2, qy = (q >> 1) * 2;
+        cells[qy][qx] = (int)quadrants[q]->nw->population;
+        cells[qy][qx + 1] = (int)quadrants[q]->ne->population;
+        cells[qy + 1][qx] = (int)quadrants[q]->sw->population;
+        cells[qy + 1][qx + 1] = (int)quadrants[q]->se->population;
+    }
+
+    struct hl_node *center[4];
+    for (int i = 0; i < 4; i++) {
+        int x = 1 + (i & 1), y = 1 + (i >> 1);
+        int n = cells[y - 1][x - 1] + cells[y - 1][x] + cells[y - 1][x + 1]
+              + cells[y][x - 1] + cells[y][x + 1]
+              + cells[y + 1][x - 1] + cells[y + 1][x] + cells[y + 1][x + 1];
+        uint16_t rule = cells[y][x] ? hashlife->kept : hashlife->born;
+        center[i] = cell_node(hashlife, (rule >> n) & 1);
+    }
+    return join(hashlife, center[0], center[1], center[2], center[3]);
+}
+
+// Center node of a level made of the inner quadrants of four nodes
+static struct hl_node *center_of(struct hashlife *hashlife, struct hl_node *nw, struct hl_node *ne,
+                                 struct hl_node *sw, struct hl_node *se) {
+    return join(hashlife, nw->se, ne->sw, sw->ne, se->nw);
+}
+
+// The center half of a node after 2^step generations, with step at most
+// level - 2. The full step is memoized in the node, shorter ones in the memo
+// table.
+static struct hl_node *successor(struct hashlife *hashlife, struct hl_node *node, int step) {
+    if (node->population == 0) {
+        return node->nw;
+    }
+    if (step > node->level - 2) {
+        step = node->level - 2;
+    }
+    int full = (step == node->level - 2);
+    struct hl_node *result = full ? node->result : find_memo(hashlife, node, step);
+    if (result) {
+        return result;
+    }
+
+    if (node->level == 2) {
+        result = step_level2(hashlife, node);
+    } else {
+        // Nine overlapping sub-nodes of half the size, each stepped
+        struct hl_node *nw = node->nw, *ne = node->ne, *sw = node->sw, *se = node->se;
+        struct hl_node *c[9];
+        c[0] = successor(hashlife, nw, step);
+        c[1] = successor(hashlife, join(hashlife, nw->ne, ne->nw, nw->se, ne->sw), step);
+        c[2] = successor(hashlife, ne, step);
+        c[3] = successor(hashlife, join(hashlife, nw->sw, nw->se, sw->nw, sw->ne), step);
+        c[4] = successor(hashlife, join(hashlife, nw->se, ne->sw, sw->ne, se->nw), step);
+        c[5] = successor(hashlife, join(hashlife, ne->sw, ne->se, se->nw, se->ne), step);
+        c[6] = successor(hashlife, sw, step);
+        c[7] = successor(hashlife, join(hashlife, sw->ne, se->nw, sw->se, se->sw), step);
+        c[8] = successor(hashlife, se, step);
+
+        if (step < node->level - 2) {
+            // The sub-nodes already advanced far enough, just take their centers
+            result = join(hashlife,
+                          center_of(hashlife, c[0], c[1], c[3], c[4]),
+                          center_of(hashlife, c[1], c[2], c[4], c[5]),
+                          center_of(hashlife, c[3], c[4], c[6], c[7]),
+                          center_of(hashlife, c[4], c[5], c[7], c[8]));
+        } else {
+            // Advance the four overlapping quarters once more
+            result = join(hashlife,
+                          successor(hashlife, join(hashlife, c[0], c[1], c[3], c[4]), step),
+                          successor(hashlife, join(hashlife, c[1], c[2], c[4], c[5]), step),
+                          successor(hashlife, join(hashlife, c[3], c[4], c[6], c[7]), step),
+                          successor(hashlife, join(hashlife, c[4], c[5], c[7], c[8]), step));
+        }
+    }
+
+    if (full) {
+        node->result = result;
+    } else {
+        add_memo(hashlife, node, step, result);
+    }
+    return result;
+}
+
+static void mark_node(struct hl_node *node) {
+    if (!node || node->marked) return;
+    node->marked = 1;
+    mark_node(node->nw);
+    mark_node(node->ne);
+    mark_node(node->sw);
+    mark_node(node->se);
+    mark_node(node->result);
+}
+
+// Free every node the root and the empty nodes cannot reach, along with the
+// memo table of shorter steps. Nodes reached keep their full-step results,
+// and those results are kept too. Only safe between steps, since a step in
+// progress holds nodes nothing else points to yet.
+void collect_hashlife(struct hashlife *hashlife) {
+    clear_memo(hashlife);
+    mark_node(hashlife->root);
+    for (int level = 0; level < 64; level++) {
+        mark_node(hashlife->empty[level]);
+    }
+
+    // The two cells are outside the table and stay marked
+    for (size_t i = 0; i < hashlife->bucket_count; i++) {
+        struct hl_node **link = &hashlife->buckets[i];
+        while (*link) {
+            struct hl_node *node = *link;
+            if (node->marked) {
+                node->marked = 0;
+                link = &node->next;
+            } else {
+                *link = node->next;
+                node->next = hashlife->free_nodes;
+                hashlife->free_nodes = node;
+                hashlife->node_count--;
+            }
+        }
+    }
+    hashlife->collections++;
+
+    // A world bigger than the budget is collected again only once it doubles
+    hashlife->collect_at = (2 * hashlife->node_count > hashlife->node_budget) ? 2 * hashlife->node_count
+                                                                               : hashlife->node_budget;
+}
+
+// Put the root in the middle of a node twice its size
+static void expand_root(struct hashlife *hashlife) {
+    struct hl_node *root = hashlife->root;
+    struct hl_node *empty = empty_node(hashlife, root->level - 1);
+    hashlife->root = join(hashlife,
+                          join(hashlife, empty, empty, empty, root->nw),
+                          join(hashlife, empty, empty, root->ne, empty),
+                          join(hashlife, empty, root->sw, empty, empty),
+                          join(hashlife, root->se, empty, empty, empty));
+    int64_t quarter = (int64_t)1 << (root->level - 1);
+    hashlife->origin_x -= quarter;
+    hashlife->origin_y -= quarter;
+}
+
+// Whether all live cells of the root are inside its central quarter-size square
+static int root_is_padded(const struct hl_node *root) {
+    return root->nw->population == root->nw->se->se->population
+        && root->ne->population == root->ne->sw->sw->population
+        && root->sw->population == root->sw->ne->ne->population
+        && root->se->population == root->se->nw->nw->population;
+}
+
+// Advance the world 2^log2_generations generations. The root is grown until
+// the pattern cannot leave the center half it returns, even moving at the
+// speed of light.
+void hashlife_step(struct hashlife *hashlife, int log2_generations) {
+    if (log2_generations < 0 || log2_generations > HL_MAX_LEVEL - 4) {
+        fprintf(stderr, "Hashlife step of 2^%d generations is out of range\n", log2_generations);
+        exit(1);
+    }
+    if (hashlife->node_count + hashlife->memo_count > hashlife->collect_at) {
+        collect_hashlife(hashlife);
+    }
+    while (hashlife->root->level < log2_generations + 3 || !root_is_padded(hashlife->root)) {
+        if (hashlife->root->level >= HL_MAX_LEVEL) {
+            fprintf(stderr, "Hashlife world grew too large!\n");
+            exit(1);
+        }
+        expand_root(hashlife);
+    }
+
+    int64_t quarter = (int64_t)1 << (hashlife->root->level - 2);
+    hashlife->root = successor(hashlife, hashlife->root, log2_generations);
+    hashlife->origin_x += quarter;
+    hashlife->origin_y += quarter;
+    hashlife->generation += (uint64_t)1 << log2_generations;
+}
+
+// Advance the world any number of generations, one power of two at a time
+void hashlife_advance(struct hashlife *hashlife, uint64_t generations) {
+    for (int bit = 0; generations; bit++, generations >>= 1) {
+        if (generations & 1) {
+            hashlife_step(hashlife, bit);
+        }
+    }
+}
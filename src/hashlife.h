@@ -0,0 +1,72 @@
+#ifndef HASHLIFE_H
+#define HASHLIFE_H
+
+#include "grid.h"
+#include "rule.h"
+
+// HashLife engine for two-state life-like rules. The world is an unbounded
+// quadtree whose nodes are hash-consed, so identical regions are stored once,
+// and every node memoizes its center after 2^(n-2) generations, as far as it
+// can see. Centers after fewer generations are memoized by node and step in
+// a table of their own, so mixing powers of two does not throw results away.
+// That lets repetitive patterns spanning millions of cells jump 2^k
+// generations at once.
+//
+// A node of level n covers 2^n x 2^n cells. Level 0 nodes are single cells.
+//
+// Between steps, once the nodes and memo entries pass the node budget, the
+// nodes no longer reachable from the root are collected and the table of
+// shorter steps is emptied. Collected nodes are reused for new ones.
+
+#define HL_NODE_BUDGET ((size_t)1 << 21)   // Nodes and memo entries before collecting, 64 bytes a node
+
+struct hl_node {
+    struct hl_node *nw, *ne, *sw, *se;  // Quadrants, NULL for cells
+    struct hl_node *result;             // Memoized center after 2^(level - 2) generations
+    struct hl_node *next;               // Hash chain, or the free list once collected
+    uint64_t population;
+    int level;
+    int marked;                         // Reached from the root while collecting
+};
+
+struct hl_block;
+struct hl_memo;
+struct hl_memo_block;
+
+struct hashlife {
+    uint16_t born;              // Bit n set if a dead cell with n live neighbors is born
+    uint16_t kept;              // Bit n set if a live cell with n live neighbors survives
+    struct hl_node **buckets;
+    size_t bucket_count;
+    size_t node_count;
+    struct hl_block *blocks;    // Node storage, freed all at once
+    struct hl_node *free_nodes; // Collected nodes, reused before the blocks grow
+    struct hl_memo **memo_buckets;      // Centers after fewer than 2^(level - 2) generations
+    size_t memo_bucket_count;
+    size_t memo_count;
+    struct hl_memo_block *memo_blocks;
+    size_t node_budget;         // HL_NODE_BUDGET unless changed
+    size_t collect_at;          // Nodes and memo entries that start the next collection
+    uint64_t collections;
+    struct hl_node *empty[64];  // Empty node per level, built on demand
+    struct hl_node *root;
+    int64_t origin_x;           // World coordinates of the root's top-left cell
+    int64_t origin_y;
+    uint64_t generation;
+};
+
+struct hashlife *create_hashlife(const struct rule *rule);
+void destroy_hashlife(struct hashlife *hashlife);
+
+void hashlife_import(struct hashlife *hashlife, struct grid *grid);
+void hashlife_export(struct hashlife *hashlife, struct grid *grid);
+
+void hashlife_step(struct hashlife *hashlife, int log2_generations);
+void hashlife_advance(struct hashlife *hashlife, uint64_t generations);
+
+int hashlife_get_cell(struct hashlife *hashlife, int64_t x, int64_t y);
+uint64_t hashlife_population(const struct hashlife *hashlife);
+size_t hashlife_node_count(const struct hashlife *hashlife);
+void collect_hashlife(struct hashlife *hashlife);
+
+#endif
@@ -0,0 +1,553 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <getopt.h>
+#include <time.h>
+#include "grid.h"
+#include "rule.h"
+#include "pool.h"
+#include "snapshot.h"
+#include "checkpoint.h"
+#include "recording.h"
+#include "activity.h"
+#include "profile.h"
+#include "arena.h"
+#include "world.h"
+#include "ensemble.h"
+#include "cycle.h"
+#include "stats.h"
+
+// Batch runs without a window: everything the GUI fixes at compile time is a
+// command-line option here, and nothing touches SDL. Generations between
+// two outputs are stepped in one call to update_grid_generations.
+
+struct headless_options {
+    int width;
+    int height;
+    int states;
+    const char *rule;
+    int generations;
+    unsigned int seed;
+    int threads;
+    int every;              // Generations between outputs, 0 writes only the last one
+    int boundary;
+    const char *output;     // NULL writes nothing
+    int text;               // Write text dumps instead of binary snapshots
+    const char *load;       // Snapshot or text dump to continue from, NULL starts a random grid
+    int rule_given;
+    int boundary_given;
+    uint64_t seek;          // Generation to load from a recording
+    const char *record;     // Record every generation into this file
+    int keyframe_interval;
+    const char *stats;      // Write per-phase timings to this file, NULL writes none
+    int sparse;             // Step an unbounded world of chunks, the grid is only its starting window
+    int ensemble;           // Members of an ensemble run, 0 runs a single grid
+    int cycles;             // Generations kept to detect a repeating grid, 0 does not look
+    int jump;               // On a repeat, jump to the last generation instead of stopping
+    int memory;             // Report peak memory and page faults at the end
+    const char *metrics;    // Log population, births and deaths of every generation here, NULL logs none
+};
+
+static void print_usage(const char *program) {
+    printf("Usage: %s [options]\n"
+           "  -W, --width N          grid width (400)\n"
+           "  -H, --height N         grid height (same as width)\n"
+           "  -s, --states N         states of the cyclic rule (8)\n"
+           "  -r, --rule RULE        cyclic, B3/S23, B36/S23, B2/S/C8, ... (cyclic); V or H\n"
+           "                         after a rule counts von Neumann or hexagonal neighbors,\n"
+           "                         as in B2/S34H, and R5,C0,M1,S34..58,B34..45,NM is a\n"
+           "                         Larger than Life rule with a radius of 5\n"
+           "  -g, --generations N    generations to run (1000)\n"
+           "  -S, --seed N           seed of the random starting grid (42)\n"
+           "  -t, --threads N        threads stepping the grid, 0 for one per CPU (1)\n"
+           "  -o, --output FILE      write a binary snapshot of the grid to FILE\n"
+           "  -e, --every N          write every N generations instead of only at the end\n"
+           "      --text             write text dumps instead of binary snapshots\n"
+           "  -l, --load FILE        continue from a snapshot, text dump or recording; its\n"
+           "                         rule and boundary apply unless given\n"
+           "      --seek N           generation to load from a recording (the last one)\n"
+           "      --record FILE      record every generation into FILE\n"
+           "      --keyframes N      frames between keyframes of a recording (64)\n"
+           "  -b, --boundary MODE    dead, torus or reflect (dead)\n"
+           "      --sparse           step an unbounded world of chunks; the grid is the window\n"
+           "                         it starts from and outputs show\n"
+           "      --cycles N         stop once the grid repeats one of its last N generations\n"
+           "      --jump             on a repeat, skip ahead to the last generation instead\n"
+           "      --ensemble N       step N grids seeded seed, seed + 1, ... in one batch and\n"
+           "                         write one CSV line per member to the output; the rule\n"
+           "                         may be a comma-separated list the members cycle through\n"
+           "      --stats FILE       write per-phase timings to FILE (needs make PROFILE=1)\n"
+           "      --memory           report peak memory and page faults at the end\n"
+           "      --metrics FILE     log live cells, births, deaths and the population of every\n"
+           "                         state to FILE as CSV, one line per generation\n"
+           "  -h, --help             show this help\n", program);
+}
+
+// Parse a non-negative integer option, exiting on anything else
+static int parse_count(const char *text, const char *option) {
+    char *end;
+    long value = strtol(text, &end, 10);
+    if (*text == '\0' || *end != '\0' || value < 0 || value > 1000000000L) {
+        fprintf(stderr, "Invalid value for --%s: %s\n", option, text);
+        exit(1);
+    }
+    return (int)value;
+}
+
+static int parse_boundary(const char *text) {
+    if (strcasecmp(text, "dead") == 0) return BOUNDARY_DEAD;
+    if (strcasecmp(text, "torus") == 0) return BOUNDARY_TORUS;
+    if (strcasecmp(text, "reflect") == 0) return BOUNDARY_REFLECT;
+    fprintf(stderr, "Invalid boundary: %s\n", text);
+    exit(1);
+}
+
+static void parse_options(int argc, char *argv[], struct headless_options *options) {
+    static const struct option long_options[] = {
+        {"width", required_argument, NULL, 'W'},
+        {"height", required_argument, NULL, 'H'},
+        {"states", required_argument, NULL, 's'},
+        {"rule", required_argument, NULL, 'r'},
+        {"generations", required_argument, NULL, 'g'},
+        {"seed", required_argument, NULL, 'S'},
+        {"threads", required_argument, NULL, 't'},
+        {"output", required_argument, NULL, 'o'},
+        {"every", required_argument, NULL, 'e'},
+        {"boundary", required_argument, NULL, 'b'},
+        {"text", no_argument, NULL, 'T'},
+        {"load", required_argument, NULL, 'l'},
+        {"seek", required_argument, NULL, 'K'},
+        {"record", required_argument, NULL, 'R'},
+        {"keyframes", required_argument, NULL, 'F'},
+        {"stats", required_argument, NULL, 'P'},
+        {"sparse", no_argument, NULL, 'Z'},
+        {"ensemble", required_argument, NULL, 'E'},
+        {"cycles", required_argument, NULL, 'C'},
+        {"jump", no_argument, NULL, 'J'},
+        {"memory", no_argument, NULL, 'M'},
+        {"metrics", required_argument, NULL, 'X'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int option;
+    while ((option = getopt_long(argc, argv, "W:H:s:r:g:S:t:o:e:b:l:h", long_options, NULL)) != -1) {
+        switch (option) {
+            case 'W': options->width = parse_count(optarg, "width"); break;
+            case 'H': options->height = parse_count(optarg, "height"); break;
+            case 's': options->states = parse_count(optarg, "states"); break;
+            case 'r': options->rule = optarg; options->rule_given = 1; break;
+            case 'g': options->generations = parse_count(optarg, "generations"); break;
+            case 'S': options->seed = (unsigned int)parse_count(optarg, "seed"); break;
+            case 't': options->threads = parse_count(optarg, "threads"); break;
+            case 'o': options->output = optarg; break;
+            case 'e': options->every = parse_count(optarg, "every"); break;
+            case 'b': options->boundary = parse_boundary(optarg); options->boundary_given = 1; break;
+            case 'T': options->text = 1; break;
+            case 'l': options->load = optarg; break;
+            case 'K': options->seek = (uint64_t)parse_count(optarg, "seek"); break;
+            case 'R': options->record = optarg; break;
+            case 'F': options->keyframe_interval = parse_count(optarg, "keyframes"); break;
+            case 'P': options->stats = optarg; break;
+            case 'Z': options->sparse = 1; break;
+            case 'E': options->ensemble = parse_count(optarg, "ensemble"); break;
+            case 'C': options->cycles = parse_count(optarg, "cycles"); break;
+            case 'J': options->jump = 1; break;
+            case 'M': options->memory = 1; break;
+            case 'X': options->metrics = optarg; break;
+            case 'h': print_usage(argv[0]); exit(0);
+            default: print_usage(argv[0]); exit(1);
+        }
+    }
+    if (optind < argc) {
+        fprintf(stderr, "Unexpected argument: %s\n", argv[optind]);
+        exit(1);
+    }
+    if (options->height == 0) {
+        options->height = options->width;
+    }
+    if (options->width < 1 || options->height < 1) {
+        fprintf(stderr, "The grid needs at least one cell\n");
+        exit(1);
+    }
+    if (options->ensemble > 0 && (options->load || options->record || options->sparse)) {
+        fprintf(stderr, "--ensemble starts every member from its seed, without --load, --record or --sparse\n");
+        exit(1);
+    }
+    if (options->ensemble > 0 && (options->cycles > 0 || options->jump || options->every > 0 || options->text)) {
+        fprintf(stderr, "--ensemble writes one CSV line per member at the end, without --cycles, --jump, "
+                        "--every or --text\n");
+        exit(1);
+    }
+    if (options->cycles > 0 && options->sparse) {
+        fprintf(stderr, "--cycles needs a dense grid, it cannot be combined with --sparse\n");
+        exit(1);
+    }
+    if (options->jump && (options->cycles == 0 || options->record)) {
+        fprintf(stderr, "--jump needs --cycles and cannot skip generations of a --record\n");
+        exit(1);
+    }
+    if (options->metrics && (options->sparse || options->ensemble > 0)) {
+        fprintf(stderr, "--metrics needs a single dense grid, it cannot be combined with --sparse or --ensemble\n");
+        exit(1);
+    }
+    if (options->sparse && options->record) {
+        fprintf(stderr, "--record needs a dense grid, it cannot be combined with --sparse\n");
+        exit(1);
+    }
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Write the grid in the requested format. Snapshots are queued on the
+// checkpoint writer so stepping carries on while they are saved.
+static void write_output(struct grid *grid, const struct rule *rule, const struct headless_options *options,
+                         struct checkpoint_writer *checkpoints) {
+    PROFILE_BEGIN(PHASE_CHECKPOINT);
+    if (options->text) {
+        write_grid_to_file(grid, options->output);
+    } else {
+        checkpoint_grid(checkpoints, grid, rule, options->seed, options->output);
+    }
+    PROFILE_END(PHASE_CHECKPOINT);
+}
+
+// Whether a piece of a comma-separated rule list carries on the Larger than
+// Life rule before it, like the S34..58 in R5,C0,M1,S34..58,B34..45,NM
+static int is_range_section(const char *piece) {
+    size_t length = strcspn(piece, ",");
+    return length > 1 && strchr("CMSBN", piece[0]) && strcspn(piece, "/") >= length;
+}
+
+// Split the rule list at the commas between rules, like strtok
+static char *next_rule_name(char *names) {
+    static char *rest;
+    if (names) rest = names;
+    while (rest && *rest == ',') rest++;
+    if (!rest || !*rest) return NULL;
+
+    char *name = rest;
+    int ranges = name[0] == 'R' && isdigit((unsigned char)name[1]);
+    char *comma = strchr(name, ',');
+    while (comma && ranges && is_range_section(comma + 1)) {
+        comma = strchr(comma + 1, ',');
+    }
+    if (comma) {
+        *comma = '\0';
+        rest = comma + 1;
+    } else {
+        rest = NULL;
+    }
+    return name;
+}
+
+// Step options->ensemble grids in one batch and write a line of results per member
+static int run_ensemble(const struct headless_options *options) {
+    // One parsed rule per entry of the comma-separated list
+    char names[256];
+    snprintf(names, sizeof(names), "%s", options->rule);
+    struct rule rules[16];
+    int rule_count = 0;
+    for (char *name = next_rule_name(names); name; name = next_rule_name(NULL)) {
+        if (rule_count == (int)(sizeof(rules) / sizeof(rules[0]))) {
+            fprintf(stderr, "At most %d rules can be swept at once\n", rule_count);
+            return 1;
+        }
+        if (parse_rule(name, &rules[rule_count]) != 0) {
+            return 1;
+        }
+        rule_count++;
+    }
+    if (rule_count == 0) {
+        fprintf(stderr, "No rule given\n");
+        return 1;
+    }
+
+    struct ensemble_member *members = calloc((size_t)options->ensemble, sizeof(struct ensemble_member));
+    if (!members) {
+        fprintf(stderr, "Memory allocation failed for ensemble!\n");
+        exit(1);
+    }
+    for (int i = 0; i < options->ensemble; i++) {
+        const struct rule *rule = &rules[i % rule_count];
+        members[i] = (struct ensemble_member){options->width, options->height, rule->states ? 0 : options->states,
+                                              options->boundary, rule, (uint64_t)options->seed + (uint64_t)i};
+    }
+
+    struct thread_pool *pool = (options->threads != 1) ? create_thread_pool(options->threads) : NULL;
+    double start = now_seconds();
+    struct ensemble *ensemble = create_ensemble(members, options->ensemble, pool);
+    free(members);
+    if (!ensemble) {
+        destroy_thread_pool(pool);
+        return 1;
+    }
+    double filled = now_seconds();
+    PROFILE_BEGIN(PHASE_STEP);
+    step_ensemble(ensemble, options->generations);
+    PROFILE_END(PHASE_STEP);
+    double seconds = now_seconds() - filled;
+
+    double cells = (double)options->width * options->height * options->ensemble;
+    printf("%d members of %dx%d, %d generations in %.3f s after %.3f s filling, %.1f Mcells/sec\n",
+           options->ensemble, options->width, options->height, options->generations, seconds, filled - start,
+           seconds > 0 ? cells * options->generations / seconds * 1e-6 : 0.0);
+
+    int status = 0;
+    if (options->output && write_ensemble_results(ensemble, options->output) != 0) {
+        status = 1;
+    }
+    destroy_ensemble(ensemble);
+    destroy_thread_pool(pool);
+    if (options->memory) {
+        print_memory_stats(stdout);
+    }
+    return status;
+}
+
+int main(int argc, char *argv[])
+{
+    struct headless_options options = {0};
+    options.width = 400;
+    options.states = 8;
+    options.rule = "cyclic";
+    options.generations = 1000;
+    options.seed = 42;
+    options.threads = 1;
+    options.boundary = BOUNDARY_DEAD;
+    options.seek = UINT64_MAX;
+    options.keyframe_interval = 64;
+    parse_options(argc, argv, &options);
+    if (options.ensemble > 0) {
+        return run_ensemble(&options);
+    }
+
+    struct rule rule;
+    if (parse_rule(options.rule, &rule) != 0) {
+        return 1;
+    }
+    int states = rule.states ? rule.states : options.states;
+    if (states < 2 || states > MAX_STATES) {
+        fprintf(stderr, "States must be between 2 and %d\n", MAX_STATES);
+        return 1;
+    }
+
+    struct grid grid;
+    if (options.load) {
+        struct snapshot_info info;
+        if (is_recording(options.load)) {
+            if (load_recorded_generation(&grid, &info, options.seek, options.load) != 0) {
+                return 1;
+            }
+        } else if (load_snapshot(&grid, &info, options.rule_given ? states : 0, options.load) != 0) {
+            return 1;
+        }
+        if (!options.rule_given && info.rule[0] && parse_rule(info.rule, &rule) != 0) {
+            return 1;
+        }
+        if (rule.states && rule.states != grid.states) {
+            fprintf(stderr, "%s has %d states, %s needs %d\n", options.load, grid.states, rule.name, rule.states);
+            return 1;
+        }
+        states = grid.states;
+        options.seed = (unsigned int)info.seed;
+        if (options.boundary_given) {
+            grid.boundary = options.boundary;
+        }
+    } else {
+        struct color black = {0, 0, 0}, white = {255, 255, 255};
+        struct color *palette = mallocpalette(states);
+        initialize_gradient_palette(palette, &black, &white, states);
+        allocate_grid(&grid, options.width, options.height, states, palette);
+        grid.boundary = options.boundary;
+    }
+    if (options.threads != 1) {
+        grid.pool = create_thread_pool(options.threads);
+    }
+    if (!options.load) {
+        initialize_random_grid(&grid, grid.grid1, options.seed); // Filled on the pool, the same for any thread count
+    }
+
+    // Two slots: one being written while the next generations are stepped
+    struct checkpoint_writer *checkpoints = create_checkpoint_writer(&grid, 2, 1);
+
+    // Recording steps one generation at a time and reuses the changed tiles
+    struct recorder *recorder = NULL;
+    if (options.record) {
+        recorder = start_recording(&grid, &rule, options.seed, options.keyframe_interval, options.record);
+        if (!recorder) {
+            return 1;
+        }
+        enable_activity_tracking(&grid);
+        record_generation(recorder, &grid);
+    }
+
+    // A sparse run steps the world and copies the grid's window back out of it
+    struct world *world = NULL;
+    if (options.sparse) {
+        world = create_world(&rule, states);
+        if (!world) {
+            return 1;
+        }
+        world->pool = grid.pool;
+        world_import(world, &grid, 0, 0);
+    }
+
+    // Cycle detection hashes every generation while it is stepped
+    struct cycle_detector *detector = NULL;
+    uint64_t last_generation = grid.generation + (uint64_t)options.generations;
+    if (options.cycles > 0) {
+        enable_grid_hashing(&grid);
+        detector = create_cycle_detector(options.cycles);
+        observe_generation(detector, grid_hash(&grid), grid.generation);
+    }
+
+    // Statistics are counted while each generation is stepped
+    FILE *metrics = NULL;
+    if (options.metrics) {
+        metrics = fopen(options.metrics, "w");
+        if (!metrics) {
+            perror(options.metrics);
+            return 1;
+        }
+        enable_grid_stats(&grid);
+        write_metrics_header(metrics, &grid);
+        write_metrics(metrics, &grid);
+    }
+
+    double start = now_seconds();
+    int done = 0;
+    while (done < options.generations) {
+        int chunk = options.generations - done;
+        if (options.every > 0 && chunk > options.every) {
+            chunk = options.every;
+        }
+        if (recorder || detector || metrics) {
+            int stepped = 0;
+            while (stepped < chunk) {
+                PROFILE_BEGIN(PHASE_STEP);
+                update_grid_with_rule(&grid, &rule);
+                PROFILE_END(PHASE_STEP);
+                stepped++;
+                if (metrics && write_metrics(metrics, &grid) != 0) {
+                    fprintf(stderr, "Error writing %s!\n", options.metrics);
+                    return 1;
+                }
+                if (recorder) {
+                    PROFILE_BEGIN(PHASE_RECORD);
+                    int recorded = record_generation(recorder, &grid);
+                    PROFILE_END(PHASE_RECORD);
+                    if (recorded != 0) {
+                        return 1;
+                    }
+                }
+                if (detector && observe_generation(detector, grid_hash(&grid), grid.generation)) {
+                    if (confirm_cycle(&grid, &rule, detector->period)) {
+                        break;
+                    }
+                    detector->period = 0;   // Only the hashes matched
+                }
+            }
+            chunk = stepped;
+        } else if (world) {
+            PROFILE_BEGIN(PHASE_STEP);
+            advance_world(world, (uint64_t)chunk);
+            PROFILE_END_EACH(PHASE_STEP, (uint64_t)chunk);
+        } else {
+            PROFILE_BEGIN(PHASE_STEP);
+            update_grid_generations(&grid, &rule, chunk);
+            PROFILE_END_EACH(PHASE_STEP, (uint64_t)chunk);
+        }
+        done += chunk;
+        if (detector && detector->period) {
+            break;
+        }
+
+        if (options.output && (options.every > 0 || done == options.generations)) {
+            if (world) {
+                world_export(world, &grid, 0, 0);
+            }
+            write_output(&grid, &rule, &options, checkpoints);
+        }
+    }
+    if (recorder && finish_recording(recorder) != 0) {
+        return 1;
+    }
+    // A repeating grid goes through the same period from then on, so the last
+    // generation is the one that many generations into the period
+    if (detector && detector->period) {
+        printf("Generation %llu repeats generation %llu, a cycle of period %llu\n",
+               (unsigned long long)grid.generation, (unsigned long long)detector->first,
+               (unsigned long long)detector->period);
+        if (options.jump) {
+            uint64_t remaining = (last_generation - grid.generation) % detector->period;
+            for (uint64_t i = 0; i < remaining; i++) {
+                update_grid_with_rule(&grid, &rule);
+            }
+            printf("Jumped from generation %llu to %llu\n", (unsigned long long)(grid.generation - remaining),
+                   (unsigned long long)last_generation);
+            grid.generation = last_generation;
+        }
+        if (options.output) {
+            write_output(&grid, &rule, &options, checkpoints);
+        }
+    }
+    destroy_cycle_detector(detector);
+    if (metrics && fclose(metrics) != 0) {
+        fprintf(stderr, "Error writing %s!\n", options.metrics);
+        return 1;
+    }
+    double seconds = now_seconds() - start;
+    if (world) {
+        world_export(world, &grid, 0, 0);
+    }
+    if (options.output && options.generations == 0) {
+        write_output(&grid, &rule, &options, checkpoints);
+    }
+
+    printf("%s %dx%d %d states, %d generations to %llu in %.3f s, %.1f gens/sec, %.1f Mcells/sec\n",
+           rule.name, grid.width, grid.height, states, done, (unsigned long long)grid.generation, seconds,
+           seconds > 0 ? done / seconds : 0.0,
+           seconds > 0 ? (double)done * grid.width * grid.height / seconds * 1e-6 : 0.0);
+
+    if (world) {
+        int64_t x0, y0, x1, y1;
+        world_bounds(world, &x0, &y0, &x1, &y1);
+        printf("%llu live cells in %zu chunks spanning [%lld, %lld) x [%lld, %lld)\n",
+               (unsigned long long)world_population(world), world->chunk_count,
+               (long long)x0, (long long)x1, (long long)y0, (long long)y1);
+        destroy_world(world);
+    }
+
+    struct checkpoint_stats stats;
+    destroy_checkpoint_writer(checkpoints, &stats);
+    if (stats.submitted > 0) {
+        printf("%llu snapshots written, %llu failed, %llu stalls for %.3f s, %.3f s writing\n",
+               (unsigned long long)stats.written, (unsigned long long)stats.failed,
+               (unsigned long long)stats.stalls, stats.stall_seconds, stats.write_seconds);
+    }
+    if (options.stats) {
+        if (!profiling_enabled()) {
+            fprintf(stderr, "Built without PROFILING, %s has no timings; rebuild with make PROFILE=1\n", options.stats);
+        }
+        FILE *file = fopen(options.stats, "w");
+        if (!file) {
+            perror(options.stats);
+            return 1;
+        }
+        write_profile_stats(file);
+        fclose(file);
+    }
+    destroy_thread_pool(grid.pool);
+    free_grid(&grid);
+    if (options.memory) {
+        print_memory_stats(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,809 @@
+#include "kernel.h"
+#include "neighborhood.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+// Specialized row-sweep kernels, one per kind of rule and cell format. The rule
+// is inlined into the loop so the only dispatch left is select_kernel, once per
+// generation. Life-like rules share one kernel that looks the next state up in
+// the rule's transition table. Neighbors come straight from the padded rows
+// above and below.
+
+// Number of live (state 1) cells among the 8 byte-cell neighbors of x
+static inline int byte_live_neighbors(const uint8_t *up, const uint8_t *mid, const uint8_t *down, int x) {
+    return (up[x - 1] == 1) + (up[x] == 1) + (up[x + 1] == 1)
+         + (mid[x - 1] == 1) + (mid[x + 1] == 1)
+         + (down[x - 1] == 1) + (down[x] == 1) + (down[x + 1] == 1);
+}
+
+static inline uint8_t table_byte(const struct rule *rule, const uint8_t *up, const uint8_t *mid, const uint8_t *down, int x, int states) {
+    (void)states;
+    return rule->table[mid[x]][byte_live_neighbors(up, mid, down, x)];
+}
+
+static inline uint8_t cyclic_byte(const struct rule *rule, const uint8_t *up, const uint8_t *mid, const uint8_t *down, int x, int states) {
+    (void)rule;
+    int state = mid[x];
+    int target = (state + 1 == states) ? 0 : state + 1;
+    int found = (up[x - 1] == target) | (up[x] == target) | (up[x + 1] == target)
+              | (mid[x - 1] == target) | (mid[x + 1] == target)
+              | (down[x - 1] == target) | (down[x] == target) | (down[x + 1] == target);
+    return found ? target : state;
+}
+
+// Add a cell that changed from state to next to partial
+static inline void count_change(struct stats_partial *partial, int state, int next) {
+    partial->births += (state == 0);
+    partial->deaths += (next == 0);
+    partial->changed++;
+    partial->population[next]++;
+    partial->population[state]--;
+}
+
+// Row pointers start at cell 0, so x - 1 and x + 1 land in the halo at the edges.
+// Each kernel comes with a counting kernel from the same inlined sweep.
+#define DEFINE_BYTE_KERNEL(cell_rule)                                                                       \
+static inline __attribute__((always_inline))                                                                \
+int cell_rule##_rows(const struct grid *grid, const struct rule *rule, const uint8_t *cells,                \
+                     uint8_t *next, int x0, int x1, int y0, int y1, struct stats_partial *partial) {        \
+    int states = grid->states;                                                                              \
+    int changed = 0;                                                                                        \
+    for (int y = y0; y < y1; y++) {                                                                         \
+        const uint8_t *up = grid_row(grid, cells, y - 1) + 1;                                               \
+        const uint8_t *mid = grid_row(grid, cells, y) + 1;                                                  \
+        const uint8_t *down = grid_row(grid, cells, y + 1) + 1;                                             \
+        uint8_t *out = grid_row(grid, next, y) + 1;                                                         \
+        for (int x = x0; x < x1; x++) {                                                                     \
+            uint8_t state = cell_rule(rule, up, mid, down, x, states);                                      \
+            if (partial && state != mid[x]) {                                                               \
+                count_change(partial, mid[x], state);                                                       \
+            }                                                                                               \
+            changed |= state ^ mid[x];                                                                      \
+            out[x] = state;                                                                                 \
+        }                                                                                                   \
+    }                                                                                                       \
+    return changed != 0;                                                                                    \
+}                                                                                                           \
+                                                                                                            \
+static int cell_rule##_kernel(const struct grid *grid, const struct rule *rule, const uint8_t *cells,       \
+                              uint8_t *next, int x0, int x1, int y0, int y1) {                              \
+    return cell_rule##_rows(grid, rule, cells, next, x0, x1, y0, y1, NULL);                                 \
+}                                                                                                           \
+                                                                                                            \
+static int cell_rule##_counting_kernel(const struct grid *grid, const struct rule *rule, const uint8_t *cells,\
+                                       uint8_t *next, int x0, int x1, int y0, int y1,                       \
+                                       struct stats_partial *partial) {                                     \
+    return cell_rule##_rows(grid, rule, cells, next, x0, x1, y0, y1, partial);                              \
+}
+
+DEFINE_BYTE_KERNEL(table_byte)
+DEFINE_BYTE_KERNEL(cyclic_byte)
+
+// Vectorized cyclic kernels for byte grids. Each lane computes the successor
+// of its cell, compares it against the eight shifted neighbor rows and takes
+// it where any of them matches, exactly like cyclic_byte. The halo's CELL_VOID
+// never equals a successor. The cells left over at the end of a row go
+// through cyclic_byte.
+//
+// Once a cyclic pattern gets going nearly every cell advances each
+// generation, so the counting kernels only count the cells that kept their
+// state, by state, and take every other cell as advanced. Vectors where all
+// cells advanced are skipped, but only past rows where few vectors kept a
+// cell, since a branch on every vector costs more than counting it while the
+// pattern is still settling. Up to KEPT_COUNTERS states are counted in
+// counters held in registers, which are added up before they can overflow.
+#define KEPT_COUNTERS 8
+
+// Every vector is counted in the row after one where more than 1 in DENSE_ROW
+// vectors kept a cell
+#define DENSE_ROW 16
+
+static inline int cyclic_byte_tail(const uint8_t *up, const uint8_t *mid, const uint8_t *down,
+                                   uint8_t *out, int x, int x1, int states, uint64_t *kept) {
+    int changed = 0;
+    for (; x < x1; x++) {
+        out[x] = cyclic_byte(NULL, up, mid, down, x, states);
+        if (kept && out[x] == mid[x]) {
+            kept[mid[x]]++;
+        }
+        changed |= out[x] ^ mid[x];
+    }
+    return changed;
+}
+
+// Add the cells of cells whose bits are set in still to kept, one at a time
+static inline void count_kept_cells(const uint8_t *cells, uint64_t still, uint64_t *kept) {
+    for (; still; still &= still - 1) {
+        kept[cells[__builtin_ctzll(still)]]++;
+    }
+}
+
+// Add a histogram of the cells that kept their state to partial, as changes
+// against every cell advancing to its successor. The sweep that starts at the
+// first cell of the grid adds every cell advancing, from the population of
+// the generation before, so it is added once per generation.
+static void count_kept_states(const struct grid *grid, const uint64_t *kept, int first,
+                              struct stats_partial *partial) {
+    int states = grid->states;
+    if (first) {
+        const uint64_t *population = grid->stats->population;
+        partial->births += population[0];
+        partial->deaths += population[states - 1];
+        partial->changed += (uint64_t)grid->width * (uint64_t)grid->height;
+        for (int s = 1; s < states; s++) {
+            partial->population[s] += population[s - 1] - population[s];
+        }
+    }
+    // Counts wrap below 0 here and come out right once all partials are added
+    for (int s = 0; s < states; s++) {
+        partial->changed -= kept[s];
+        partial->population[s] += kept[s];
+        partial->population[(s + 1 == states) ? 0 : s + 1] -= kept[s];
+    }
+    partial->births -= kept[0];
+    partial->deaths -= kept[states - 1];
+}
+
+#ifdef HAVE_X86_KERNELS
+// The AVX2 and AVX512 counters are nibbles, two states to a byte. Looking a
+// kept cell's state up in nibble_table(s / 2) adds 1 to the low nibble for an
+// even state and to the high nibble for an odd one. They are added up every
+// NIBBLE_VECTORS vectors.
+#define NIBBLE_VECTORS 15
+
+static inline __m128i nibble_table(int v) {
+    uint8_t bytes[16] = {0};
+    bytes[2 * v] = 1;
+    bytes[2 * v + 1] = 16;
+    return _mm_loadu_si128((const __m128i *)bytes);
+}
+
+// Byte counters of the cells kept in each state, and how many vectors they
+// have counted since they were last added up
+struct kept_sse2 {
+    __m128i counts[KEPT_COUNTERS];
+    int vectors;
+};
+
+__attribute__((target("sse2"))) static inline __attribute__((always_inline))
+void add_kept_sse2(struct kept_sse2 *lanes, uint64_t *kept) {
+#pragma GCC unroll 8
+    for (int s = 0; s < KEPT_COUNTERS; s++) {
+        __m128i sums = _mm_sad_epu8(lanes->counts[s], _mm_setzero_si128());
+        kept[s] += (uint64_t)_mm_cvtsi128_si64(sums) + (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(sums, sums));
+        lanes->counts[s] = _mm_setzero_si128();
+    }
+    lanes->vectors = 0;
+}
+
+// Count the cells of a vector that kept their state, where found is clear
+__attribute__((target("sse2"))) static inline __attribute__((always_inline))
+void count_kept_sse2(struct kept_sse2 *lanes, const uint8_t *cells, __m128i state, __m128i found, int states,
+                     uint64_t *kept) {
+    if (states > KEPT_COUNTERS) {
+        count_kept_cells(cells, (uint64_t)(~_mm_movemask_epi8(found) & 0xFFFF), kept);
+        return;
+    }
+    __m128i still = _mm_or_si128(state, found);  // Advanced cells read as 0xFF, which is no state
+#pragma GCC unroll 8
+    for (int s = 0; s < KEPT_COUNTERS; s++) {
+        if (s < states) {
+            lanes->counts[s] = _mm_sub_epi8(lanes->counts[s], _mm_cmpeq_epi8(still, _mm_set1_epi8((char)s)));
+        }
+    }
+    if (++lanes->vectors == 255) {
+        add_kept_sse2(lanes, kept);
+    }
+}
+
+__attribute__((target("sse2"))) static inline __attribute__((always_inline))
+int cyclic_sse2_rows(const struct grid *grid, const uint8_t *cells, uint8_t *next, int x0, int x1, int y0, int y1,
+                     struct stats_partial *partial) {
+    int changed = 0;
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i wrap = _mm_set1_epi8((char)grid->states);
+    __m128i diff = _mm_setzero_si128();
+    struct kept_sse2 lanes = {0};
+    uint64_t kept[MAX_STATES];
+    if (partial) {
+        memset(kept, 0, (size_t)grid->states * sizeof(uint64_t));
+    }
+    int dense = 0;
+
+    for (int y = y0; y < y1; y++) {
+        const uint8_t *up = grid_row(grid, cells, y - 1) + 1;
+        const uint8_t *mid = grid_row(grid, cells, y) + 1;
+        const uint8_t *down = grid_row(grid, cells, y + 1) + 1;
+        uint8_t *out = grid_row(grid, next, y) + 1;
+        int x = x0;
+        int noted = 0;
+
+        for (; x + 16 <= x1; x += 16) {
+            __m128i state = _mm_loadu_si128((const __m128i *)(mid + x));
+            __m128i target = _mm_add_epi8(state, one);
+            target = _mm_andnot_si128(_mm_cmpeq_epi8(target, wrap), target);
+
+            __m128i found = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(up + x - 1)), target);
+            found = _mm_or_si128(found, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(up + x)), target));
+            found = _mm_or_si128(found, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(up + x + 1)), target));
+            found = _mm_or_si128(found, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(mid + x - 1)), target));
+            found = _mm_or_si128(found, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(mid + x + 1)), target));
+            found = _mm_or_si128(found, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(down + x - 1)), target));
+            found = _mm_or_si128(found, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(down + x)), target));
+            found = _mm_or_si128(found, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(down + x + 1)), target));
+
+            __m128i result = _mm_or_si128(_mm_and_si128(found, target), _mm_andnot_si128(found, state));
+            diff = _mm_or_si128(diff, found);  // A successor always differs from the state it replaces
+            _mm_storeu_si128((__m128i *)(out + x), result);
+            int kept_any = _mm_movemask_epi8(found) != 0xFFFF;
+            noted += kept_any;
+            if (partial && (dense || kept_any)) {
+                count_kept_sse2(&lanes, mid + x, state, found, grid->states, kept);
+            }
+        }
+        dense = noted * DENSE_ROW > (x1 - x0) / 16;
+        changed |= cyclic_byte_tail(up, mid, down, out, x, x1, grid->states, partial ? kept : NULL);
+    }
+    changed |= _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) != 0xFFFF;
+    if (partial) {
+        add_kept_sse2(&lanes, kept);
+        count_kept_states(grid, kept, x0 == 0 && y0 == 0, partial);
+    }
+    return changed != 0;
+}
+
+struct kept_avx2 {
+    __m256i nibbles[KEPT_COUNTERS / 2];
+    __m256i sums[KEPT_COUNTERS];
+    int vectors;
+};
+
+__attribute__((target("avx2,popcnt"))) static inline __attribute__((always_inline))
+void add_nibbles_avx2(struct kept_avx2 *lanes) {
+    const __m256i low = _mm256_set1_epi8(0x0F);
+#pragma GCC unroll 4
+    for (int v = 0; v < KEPT_COUNTERS / 2; v++) {
+        __m256i even = _mm256_and_si256(lanes->nibbles[v], low);
+        __m256i odd = _mm256_and_si256(_mm256_srli_epi16(lanes->nibbles[v], 4), low);
+        lanes->sums[2 * v] = _mm256_add_epi64(lanes->sums[2 * v], _mm256_sad_epu8(even, _mm256_setzero_si256()));
+        lanes->sums[2 * v + 1] = _mm256_add_epi64(lanes->sums[2 * v + 1], _mm256_sad_epu8(odd, _mm256_setzero_si256()));
+        lanes->nibbles[v] = _mm256_setzero_si256();
+    }
+    lanes->vectors = 0;
+}
+
+__attribute__((target("avx2,popcnt"))) static inline __attribute__((always_inline))
+void add_kept_avx2(struct kept_avx2 *lanes, uint64_t *kept) {
+    add_nibbles_avx2(lanes);
+#pragma GCC unroll 8
+    for (int s = 0; s < KEPT_COUNTERS; s++) {
+        __m128i half = _mm_add_epi64(_mm256_castsi256_si128(lanes->sums[s]), _mm256_extracti128_si256(lanes->sums[s], 1));
+        kept[s] += (uint64_t)_mm_cvtsi128_si64(half) + (uint64_t)_mm_extract_epi64(half, 1);
+        lanes->sums[s] = _mm256_setzero_si256();
+    }
+}
+
+// Past KEPT_COUNTERS states each state is counted with a compare and popcnt
+__attribute__((target("avx2,popcnt"))) static inline __attribute__((always_inline))
+void count_kept_avx2(struct kept_avx2 *lanes, const __m256i *tables, __m256i state, __m256i found, int states,
+                     uint64_t *kept) {
+    if (states > KEPT_COUNTERS) {
+        uint32_t still = ~(uint32_t)_mm256_movemask_epi8(found);
+        for (int s = 0; s < states; s++) {
+            __m256i match = _mm256_cmpeq_epi8(state, _mm256_set1_epi8((char)s));
+            kept[s] += (uint64_t)__builtin_popcount(still & (uint32_t)_mm256_movemask_epi8(match));
+        }
+        return;
+    }
+    __m256i still = _mm256_or_si256(state, found);  // Advanced cells look up 0
+#pragma GCC unroll 4
+    for (int v = 0; v < KEPT_COUNTERS / 2; v++) {
+        lanes->nibbles[v] = _mm256_add_epi8(lanes->nibbles[v], _mm256_shuffle_epi8(tables[v], still));
+    }
+    if (++lanes->vectors == NIBBLE_VECTORS) {
+        add_nibbles_avx2(lanes);
+    }
+}
+
+__attribute__((target("avx2,popcnt"))) static inline __attribute__((always_inline))
+int cyclic_avx2_rows(const struct grid *grid, const uint8_t *cells, uint8_t *next, int x0, int x1, int y0, int y1,
+                     struct stats_partial *partial) {
+    int changed = 0;
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i wrap = _mm256_set1_epi8((char)grid->states);
+    __m256i diff = _mm256_setzero_si256();
+    struct kept_avx2 lanes = {0};
+    __m256i tables[KEPT_COUNTERS / 2];
+    for (int v = 0; v < KEPT_COUNTERS / 2; v++) {
+        tables[v] = _mm256_broadcastsi128_si256(nibble_table(v));
+    }
+    uint64_t kept[MAX_STATES];
+    if (partial) {
+        memset(kept, 0, (size_t)grid->states * sizeof(uint64_t));
+    }
+    int dense = 0;
+
+    for (int y = y0; y < y1; y++) {
+        const uint8_t *up = grid_row(grid, cells, y - 1) + 1;
+        const uint8_t *mid = grid_row(grid, cells, y) + 1;
+        const uint8_t *down = grid_row(grid, cells, y + 1) + 1;
+        uint8_t *out = grid_row(grid, next, y) + 1;
+        int x = x0;
+        int noted = 0;
+
+        for (; x + 32 <= x1; x += 32) {
+            __m256i state = _mm256_loadu_si256((const __m256i *)(mid + x));
+            __m256i target = _mm256_add_epi8(state, one);
+            target = _mm256_andnot_si256(_mm256_cmpeq_epi8(target, wrap), target);
+
+            __m256i found = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(up + x - 1)), target);
+            found = _mm256_or_si256(found, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(up + x)), target));
+            found = _mm256_or_si256(found, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(up + x + 1)), target));
+            found = _mm256_or_si256(found, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(mid + x - 1)), target));
+            found = _mm256_or_si256(found, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(mid + x + 1)), target));
+            found = _mm256_or_si256(found, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(down + x - 1)), target));
+            found = _mm256_or_si256(found, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(down + x)), target));
+            found = _mm256_or_si256(found, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(down + x + 1)), target));
+
+            __m256i result = _mm256_blendv_epi8(state, target, found);
+            diff = _mm256_or_si256(diff, found);
+            _mm256_storeu_si256((__m256i *)(out + x), result);
+            int kept_any = _mm256_movemask_epi8(found) != -1;
+            noted += kept_any;
+            if (partial && (dense || kept_any)) {
+                count_kept_avx2(&lanes, tables, state, found, grid->states, kept);
+            }
+        }
+        dense = noted * DENSE_ROW > (x1 - x0) / 32;
+        changed |= cyclic_byte_tail(up, mid, down, out, x, x1, grid->states, partial ? kept : NULL);
+    }
+    changed |= !_mm256_testz_si256(diff, diff);
+    if (partial) {
+        add_kept_avx2(&lanes, kept);
+        count_kept_states(grid, kept, x0 == 0 && y0 == 0, partial);
+    }
+    return changed != 0;
+}
+
+struct kept_avx512 {
+    __m512i nibbles[KEPT_COUNTERS / 2];
+    __m512i sums[KEPT_COUNTERS];
+    int vectors;
+};
+
+__attribute__((target("avx512f,avx512bw,popcnt"))) static inline __attribute__((always_inline))
+void add_nibbles_avx512(struct kept_avx512 *lanes) {
+    const __m512i low = _mm512_set1_epi8(0x0F);
+#pragma GCC unroll 4
+    for (int v = 0; v < KEPT_COUNTERS / 2; v++) {
+        __m512i even = _mm512_and_si512(lanes->nibbles[v], low);
+        __m512i odd = _mm512_and_si512(_mm512_srli_epi16(lanes->nibbles[v], 4), low);
+        lanes->sums[2 * v] = _mm512_add_epi64(lanes->sums[2 * v], _mm512_sad_epu8(even, _mm512_setzero_si512()));
+        lanes->sums[2 * v + 1] = _mm512_add_epi64(lanes->sums[2 * v + 1], _mm512_sad_epu8(odd, _mm512_setzero_si512()));
+        lanes->nibbles[v] = _mm512_setzero_si512();
+    }
+    lanes->vectors = 0;
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt"))) static inline __attribute__((always_inline))
+void add_kept_avx512(struct kept_avx512 *lanes, uint64_t *kept) {
+    add_nibbles_avx512(lanes);
+#pragma GCC unroll 8
+    for (int s = 0; s < KEPT_COUNTERS; s++) {
+        kept[s] += (uint64_t)_mm512_reduce_add_epi64(lanes->sums[s]);
+        lanes->sums[s] = _mm512_setzero_si512();
+    }
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt"))) static inline __attribute__((always_inline))
+void count_kept_avx512(struct kept_avx512 *lanes, const __m512i *tables, __m512i state, __mmask64 still, int states,
+                       uint64_t *kept) {
+    if (states > KEPT_COUNTERS) {
+        for (int s = 0; s < states; s++) {
+            __mmask64 match = _mm512_mask_cmpeq_epi8_mask(still, state, _mm512_set1_epi8((char)s));
+            kept[s] += (uint64_t)__builtin_popcountll(match);
+        }
+        return;
+    }
+#pragma GCC unroll 4
+    for (int v = 0; v < KEPT_COUNTERS / 2; v++) {
+        lanes->nibbles[v] = _mm512_add_epi8(lanes->nibbles[v], _mm512_maskz_shuffle_epi8(still, tables[v], state));
+    }
+    if (++lanes->vectors == NIBBLE_VECTORS) {
+        add_nibbles_avx512(lanes);
+    }
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt"))) static inline __attribute__((always_inline))
+int cyclic_avx512_rows(const struct grid *grid, const uint8_t *cells, uint8_t *next, int x0, int x1, int y0, int y1,
+                       struct stats_partial *partial) {
+    int changed = 0;
+    const __m512i one = _mm512_set1_epi8(1);
+    const __m512i wrap = _mm512_set1_epi8((char)grid->states);
+    const __m512i zero = _mm512_setzero_si512();
+    __mmask64 diff = 0;
+    struct kept_avx512 lanes = {0};
+    __m512i tables[KEPT_COUNTERS / 2];
+    for (int v = 0; v < KEPT_COUNTERS / 2; v++) {
+        tables[v] = _mm512_broadcast_i32x4(nibble_table(v));
+    }
+    uint64_t kept[MAX_STATES];
+    if (partial) {
+        memset(kept, 0, (size_t)grid->states * sizeof(uint64_t));
+    }
+    int dense = 0;
+
+    for (int y = y0; y < y1; y++) {
+        const uint8_t *up = grid_row(grid, cells, y - 1) + 1;
+        const uint8_t *mid = grid_row(grid, cells, y) + 1;
+        const uint8_t *down = grid_row(grid, cells, y + 1) + 1;
+        uint8_t *out = grid_row(grid, next, y) + 1;
+        int x = x0;
+        int noted = 0;
+
+        for (; x + 64 <= x1; x += 64) {
+            __m512i state = _mm512_loadu_si512(mid + x);
+            __m512i target = _mm512_add_epi8(state, one);
+            target = _mm512_mask_blend_epi8(_mm512_cmpeq_epi8_mask(target, wrap), target, zero);
+
+            __mmask64 found = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(up + x - 1), target)
+                            | _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(up + x), target)
+                            | _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(up + x + 1), target)
+                            | _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(mid + x - 1), target)
+                            | _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(mid + x + 1), target)
+                            | _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(down + x - 1), target)
+                            | _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(down + x), target)
+                            | _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(down + x + 1), target);
+
+            diff |= found;
+            _mm512_storeu_si512(out + x, _mm512_mask_blend_epi8(found, state, target));
+            noted += ~found != 0;
+            if (partial && (dense || ~found)) {
+                count_kept_avx512(&lanes, tables, state, ~found, grid->states, kept);
+            }
+        }
+        dense = noted * DENSE_ROW > (x1 - x0) / 64;
+        changed |= cyclic_byte_tail(up, mid, down, out, x, x1, grid->states, partial ? kept : NULL);
+    }
+    changed |= (diff != 0);
+    if (partial) {
+        add_kept_avx512(&lanes, kept);
+        count_kept_states(grid, kept, x0 == 0 && y0 == 0, partial);
+    }
+    return changed != 0;
+}
+
+// Each vectorized sweep as a kernel and a counting kernel
+#define DEFINE_CYCLIC_KERNELS(isa, target_isa)                                                              \
+__attribute__((target(target_isa)))                                                                         \
+static int cyclic_##isa##_kernel(const struct grid *grid, const struct rule *rule, const uint8_t *cells,    \
+                                 uint8_t *next, int x0, int x1, int y0, int y1) {                           \
+    (void)rule;                                                                                             \
+    return cyclic_##isa##_rows(grid, cells, next, x0, x1, y0, y1, NULL);                                    \
+}                                                                                                           \
+                                                                                                            \
+__attribute__((target(target_isa)))                                                                         \
+static int cyclic_##isa##_counting_kernel(const struct grid *grid, const struct rule *rule,                 \
+                                          const uint8_t *cells, uint8_t *next, int x0, int x1,              \
+                                          int y0, int y1, struct stats_partial *partial) {                  \
+    (void)rule;                                                                                             \
+    return cyclic_##isa##_rows(grid, cells, next, x0, x1, y0, y1, partial);                                 \
+}
+
+DEFINE_CYCLIC_KERNELS(sse2, "sse2")
+DEFINE_CYCLIC_KERNELS(avx2, "avx2,popcnt")
+DEFINE_CYCLIC_KERNELS(avx512, "avx512f,avx512bw,popcnt")
+#endif
+
+static int kernel_isa = -1;
+
+// Best instruction set the cyclic byte kernel can use on this CPU
+int detect_kernel_isa(void) {
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) return KERNEL_ISA_AVX512;
+    if (__builtin_cpu_supports("avx2")) return KERNEL_ISA_AVX2;
+    if (__builtin_cpu_supports("sse2")) return KERNEL_ISA_SSE2;
+#endif
+    return KERNEL_ISA_SCALAR;
+}
+
+// Force the instruction set used by the kernels, capped at what the CPU supports.
+// Pass -1 to go back to the best one available.
+void set_kernel_isa(int isa) {
+    int best = detect_kernel_isa();
+    kernel_isa = (isa < 0 || isa > best) ? best : isa;
+}
+
+int get_kernel_isa(void) {
+    if (kernel_isa < 0) {
+        set_kernel_isa(-1);
+    }
+    return kernel_isa;
+}
+
+const char *kernel_isa_name(int isa) {
+    switch (isa) {
+        case KERNEL_ISA_SSE2: return "sse2";
+        case KERNEL_ISA_AVX2: return "avx2";
+        case KERNEL_ISA_AVX512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+static step_kernel cyclic_byte_kernel_for_isa(int isa) {
+#ifdef HAVE_X86_KERNELS
+    switch (isa) {
+        case KERNEL_ISA_AVX512: return cyclic_avx512_kernel;
+        case KERNEL_ISA_AVX2: return cyclic_avx2_kernel;
+        case KERNEL_ISA_SSE2: return cyclic_sse2_kernel;
+        default: break;
+    }
+#else
+    (void)isa;
+#endif
+    return cyclic_byte_kernel;
+}
+
+static counting_kernel cyclic_byte_counting_kernel_for_isa(int isa) {
+#ifdef HAVE_X86_KERNELS
+    switch (isa) {
+        case KERNEL_ISA_AVX512: return cyclic_avx512_counting_kernel;
+        case KERNEL_ISA_AVX2: return cyclic_avx2_counting_kernel;
+        case KERNEL_ISA_SSE2: return cyclic_sse2_counting_kernel;
+        default: break;
+    }
+#else
+    (void)isa;
+#endif
+    return cyclic_byte_counting_kernel;
+}
+
+// Bit grids are stepped 64 cells per word. For each word of a row the eight
+// neighbor masks are built with shifts that carry bits in from the adjacent
+// words, then summed by bit-sliced full adders into four count planes.
+struct neighbor_words {
+    uint64_t nw, n, ne, w, e, sw, s, se;
+};
+
+// Word w of a row with every bit replaced by its west neighbor
+static inline uint64_t west_of(const uint64_t *row, size_t w) {
+    return (row[w] << 1) | (w > 0 ? row[w - 1] >> 63 : 0);
+}
+
+// Word w of a row with every bit replaced by its east neighbor
+static inline uint64_t east_of(const uint64_t *row, size_t w, size_t words) {
+    return (row[w] >> 1) | (w + 1 < words ? row[w + 1] << 63 : 0);
+}
+
+static inline void load_neighbors(const uint64_t *up, const uint64_t *mid, const uint64_t *down,
+                                  size_t w, size_t words, struct neighbor_words *nb) {
+    nb->nw = west_of(up, w);
+    nb->n = up[w];
+    nb->ne = east_of(up, w, words);
+    nb->w = west_of(mid, w);
+    nb->e = east_of(mid, w, words);
+    nb->sw = west_of(down, w);
+    nb->s = down[w];
+    nb->se = east_of(down, w, words);
+}
+
+// Sum three masks: sum holds the ones bit of the count, carry the twos bit
+static inline void full_add(uint64_t a, uint64_t b, uint64_t c, uint64_t *sum, uint64_t *carry) {
+    uint64_t ab = a ^ b;
+    *sum = ab ^ c;
+    *carry = (a & b) | (ab & c);
+}
+
+// Count the live neighbors of 64 cells at once into bit planes of weight 1, 2, 4 and 8
+static inline void count_planes(const struct neighbor_words *nb, uint64_t planes[4]) {
+    uint64_t up_sum, up_carry, down_sum, down_carry, ones_carry, twos_sum, twos_carry;
+    full_add(nb->nw, nb->n, nb->ne, &up_sum, &up_carry);
+    full_add(nb->sw, nb->s, nb->se, &down_sum, &down_carry);
+    uint64_t mid_sum = nb->w ^ nb->e;
+    uint64_t mid_carry = nb->w & nb->e;
+
+    full_add(up_sum, down_sum, mid_sum, &planes[0], &ones_carry);
+    full_add(up_carry, down_carry, mid_carry, &twos_sum, &twos_carry);
+    planes[1] = twos_sum ^ ones_carry;
+    uint64_t fours = twos_sum & ones_carry;
+    planes[2] = twos_carry ^ fours;
+    planes[3] = twos_carry & fours;
+}
+
+// Bits of a word holding cells of the grid rather than halo or padding
+static inline uint64_t interior_mask(size_t w, int width) {
+    uint64_t mask = ~(uint64_t)0;
+    if (w == 0) mask &= ~(uint64_t)1;
+    if (w == (size_t)width >> 6 && (width & 63) != 63) {
+        mask &= ((uint64_t)2 << (width & 63)) - 1;
+    }
+    return mask;
+}
+
+// Add the births and changes among the cells of a bit grid to partial, the
+// live cells as their change
+static void count_bit_changes(struct stats_partial *partial, uint64_t births, uint64_t changed) {
+    uint64_t deaths = changed - births;
+    partial->births += births;
+    partial->deaths += deaths;
+    partial->changed += changed;
+    partial->population[1] += births - deaths;
+}
+
+// Bit kernels step whole words, from the word holding cell x0 to the one
+// holding cell x1 - 1, so column ranges should follow word boundaries. Their
+// counting kernels need the popcnt instruction.
+static inline __attribute__((always_inline))
+int life_like_bit_rows(const struct grid *grid, const struct rule *rule, const uint8_t *cells, uint8_t *next,
+                       int x0, int x1, int y0, int y1, struct stats_partial *partial) {
+    size_t words = grid->stride / sizeof(uint64_t);
+    size_t first = (size_t)(x0 + 1) >> 6;
+    size_t last = (size_t)x1 >> 6;      // Cell x1 - 1 sits at padded bit x1
+    uint64_t diff = 0, births = 0, changed = 0;
+
+    // Only the neighbor counts that lead to a live cell need to be checked
+    int counts[NEIGHBOR_COUNTS];
+    uint64_t born[NEIGHBOR_COUNTS], kept[NEIGHBOR_COUNTS];
+    int total = 0;
+    for (int n = 0; n < NEIGHBOR_COUNTS; n++) {
+        if (rule->table[0][n] == 1 || rule->table[1][n] == 1) {
+            counts[total] = n;
+            born[total] = (rule->table[0][n] == 1) ? ~(uint64_t)0 : 0;
+            kept[total] = (rule->table[1][n] == 1) ? ~(uint64_t)0 : 0;
+            total++;
+        }
+    }
+
+    for (int y = y0; y < y1; y++) {
+        const uint64_t *up = (const uint64_t *)grid_row(grid, cells, y - 1);
+        const uint64_t *mid = (const uint64_t *)grid_row(grid, cells, y);
+        const uint64_t *down = (const uint64_t *)grid_row(grid, cells, y + 1);
+        uint64_t *out = (uint64_t *)grid_row(grid, next, y);
+
+        for (size_t w = first; w <= last; w++) {
+            struct neighbor_words nb;
+            uint64_t planes[4];
+            load_neighbors(up, mid, down, w, words, &nb);
+            count_planes(&nb, planes);
+
+            uint64_t alive = mid[w];
+            uint64_t result = 0;
+            for (int i = 0; i < total; i++) {
+                int n = counts[i];
+                uint64_t equal = ((n & 1) ? planes[0] : ~planes[0])
+                               & ((n & 2) ? planes[1] : ~planes[1])
+                               & ((n & 4) ? planes[2] : ~planes[2])
+                               & ((n & 8) ? planes[3] : ~planes[3]);
+                result |= equal & ((alive & kept[i]) | (~alive & born[i]));
+            }
+            uint64_t mask = interior_mask(w, grid->width);
+            out[w] = result & mask;
+            diff |= (result ^ alive) & mask;
+            if (partial) {
+                births += (uint64_t)__builtin_popcountll(result & ~alive & mask);
+                changed += (uint64_t)__builtin_popcountll((result ^ alive) & mask);
+            }
+        }
+    }
+    if (partial) {
+        count_bit_changes(partial, births, changed);
+    }
+    return diff != 0;
+}
+
+// With two states the successor is the other state, so a live cell survives
+// only if all neighbors are live and a dead cell turns live if any neighbor is.
+// A dead halo reads as 0 on bit grids, which must not count as the successor
+// of the live edge cells, so for them it is taken as live instead.
+static inline __attribute__((always_inline))
+int cyclic_bit_rows(const struct grid *grid, const uint8_t *cells, uint8_t *next, int x0, int x1, int y0, int y1,
+                    struct stats_partial *partial) {
+    size_t words = grid->stride / sizeof(uint64_t);
+    size_t first = (size_t)(x0 + 1) >> 6;
+    size_t last = (size_t)x1 >> 6;
+    uint64_t diff = 0, births = 0, changed = 0;
+    int dead = (grid->boundary == BOUNDARY_DEAD);
+
+    for (int y = y0; y < y1; y++) {
+        const uint64_t *up = (const uint64_t *)grid_row(grid, cells, y - 1);
+        const uint64_t *mid = (const uint64_t *)grid_row(grid, cells, y);
+        const uint64_t *down = (const uint64_t *)grid_row(grid, cells, y + 1);
+        uint64_t *out = (uint64_t *)grid_row(grid, next, y);
+        uint64_t above = (dead && y == 0) ? ~(uint64_t)0 : 0;
+        uint64_t below = (dead && y == grid->height - 1) ? ~(uint64_t)0 : 0;
+
+        for (size_t w = first; w <= last; w++) {
+            struct neighbor_words nb;
+            load_neighbors(up, mid, down, w, words, &nb);
+            // Cell 0 is bit 1 of the first word, cell width - 1 bit width of the row
+            uint64_t west = (dead && w == 0) ? 2 : 0;
+            uint64_t east = (dead && w == (size_t)grid->width >> 6) ? (uint64_t)1 << (grid->width & 63) : 0;
+            uint64_t any = nb.nw | nb.n | nb.ne | nb.w | nb.e | nb.sw | nb.s | nb.se;
+            uint64_t all = (nb.nw | west | above) & (nb.n | above) & (nb.ne | east | above)
+                         & (nb.w | west) & (nb.e | east)
+                         & (nb.sw | west | below) & (nb.s | below) & (nb.se | east | below);
+            uint64_t mask = interior_mask(w, grid->width);
+            uint64_t result = ((mid[w] & all) | (~mid[w] & any)) & mask;
+            out[w] = result;
+            diff |= (result ^ mid[w]) & mask;
+            if (partial) {
+                births += (uint64_t)__builtin_popcountll(result & ~mid[w]);
+                changed += (uint64_t)__builtin_popcountll((result ^ mid[w]) & mask);
+            }
+        }
+    }
+    if (partial) {
+        count_bit_changes(partial, births, changed);
+    }
+    return diff != 0;
+}
+
+#ifdef HAVE_X86_KERNELS
+#define COUNTING_TARGET __attribute__((target("popcnt")))
+#else
+#define COUNTING_TARGET
+#endif
+
+static int life_like_bit_kernel(const struct grid *grid, const struct rule *rule, const uint8_t *cells,
+                                uint8_t *next, int x0, int x1, int y0, int y1) {
+    return life_like_bit_rows(grid, rule, cells, next, x0, x1, y0, y1, NULL);
+}
+
+COUNTING_TARGET
+static int life_like_bit_counting_kernel(const struct grid *grid, const struct rule *rule, const uint8_t *cells,
+                                         uint8_t *next, int x0, int x1, int y0, int y1,
+                                         struct stats_partial *partial) {
+    return life_like_bit_rows(grid, rule, cells, next, x0, x1, y0, y1, partial);
+}
+
+static int cyclic_bit_kernel(const struct grid *grid, const struct rule *rule, const uint8_t *cells,
+                             uint8_t *next, int x0, int x1, int y0, int y1) {
+    (void)rule;
+    return cyclic_bit_rows(grid, cells, next, x0, x1, y0, y1, NULL);
+}
+
+COUNTING_TARGET
+static int cyclic_bit_counting_kernel(const struct grid *grid, const struct rule *rule, const uint8_t *cells,
+                                      uint8_t *next, int x0, int x1, int y0, int y1,
+                                      struct stats_partial *partial) {
+    (void)rule;
+    return cyclic_bit_rows(grid, cells, next, x0, x1, y0, y1, partial);
+}
+
+// Pick the specialized kernel for a rule and the grid's cell format
+step_kernel select_kernel(const struct grid *grid, const struct rule *rule) {
+    int bits = (grid->format == CELL_FORMAT_BITS);
+    if (uses_neighborhood_kernel(rule)) {
+        return neighborhood_kernel;
+    }
+    if (rule->kind == RULE_CYCLIC) {
+        return bits ? cyclic_bit_kernel : cyclic_byte_kernel_for_isa(get_kernel_isa());
+    }
+    return bits ? life_like_bit_kernel : table_byte_kernel;
+}
+
+// The counting kernel for a rule and the grid's cell format, or NULL where
+// the statistics are counted after stepping: for neighborhood rules, and for
+// bit grids on CPUs without popcnt
+counting_kernel select_counting_kernel(const struct grid *grid, const struct rule *rule) {
+    int bits = (grid->format == CELL_FORMAT_BITS);
+    if (uses_neighborhood_kernel(rule)) {
+        return NULL;
+    }
+#ifdef HAVE_X86_KERNELS
+    // Every CPU with AVX2 has popcnt
+    if (bits && get_kernel_isa() < KERNEL_ISA_AVX2) {
+        return NULL;
+    }
+#endif
+    if (rule->kind == RULE_CYCLIC) {
+        return bits ? cyclic_bit_counting_kernel : cyclic_byte_counting_kernel_for_isa(get_kernel_isa());
+    }
+    return bits ? life_like_bit_counting_kernel : table_byte_counting_kernel;
+}
@@ -0,0 +1,37 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include "grid.h"
+#include "rule.h"
+
+// A kernel steps the cells in columns [x0, x1) of rows [y0, y1) from cells
+// into next, with the rule inlined into the row sweep, and returns whether
+// any of them changed. The halo of cells must be up to date.
+typedef int (*step_kernel)(const struct grid *grid, const struct rule *rule, const uint8_t *cells,
+                           uint8_t *next, int x0, int x1, int y0, int y1);
+
+struct stats_partial;
+
+// A counting kernel steps like a kernel and adds the births, deaths and
+// changes of the cells it steps to partial while they are in registers, with
+// the population as its change against the generation before
+typedef int (*counting_kernel)(const struct grid *grid, const struct rule *rule, const uint8_t *cells,
+                               uint8_t *next, int x0, int x1, int y0, int y1, struct stats_partial *partial);
+
+// Instruction sets the vectorized kernels can be built for, in increasing order
+enum kernel_isa {
+    KERNEL_ISA_SCALAR,
+    KERNEL_ISA_SSE2,
+    KERNEL_ISA_AVX2,
+    KERNEL_ISA_AVX512
+};
+
+int detect_kernel_isa(void);
+void set_kernel_isa(int isa);
+int get_kernel_isa(void);
+const char *kernel_isa_name(int isa);
+
+step_kernel select_kernel(const struct grid *grid, const struct rule *rule);
+counting_kernel select_counting_kernel(const struct grid *grid, const struct rule *rule);
+
+#endif
@@ -1,26 +1,41 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "grid.h"
+#include "rule.h"
+#include "pool.h"
+#include "render.h"
+#include "simulation.h"
+#include "snapshot.h"
+#include "checkpoint.h"
+#include "profile.h"
+#include "overlay.h"
 
 const int  GRID_WIDTH = 400; // Define GRID_WIDTH and GRID_HEIGHT appropriately
 const int GRID_HEIGHT = GRID_WIDTH; // Define GRID_HEIGHT
 
-// Constants for window dimensions based on grid dimensions and cell size
-const int WINDOW_WIDTH = GRID_WIDTH * CELL_SIZE; // Define GRID_WIDTH and GRID_HEIGHT appropriately
-const int WINDOW_HEIGHT = GRID_HEIGHT * CELL_SIZE; // Define GRID_HEIGHT
-int delay_ms = 100; // Initial delay (in milliseconds)
+int delay_ms = 100; // Initial delay between generations (in milliseconds)
 int iterations = 0;
 int save_frequency = 20;
 int states = 8;
-char filename[100] = "./data/grid.txt";
+int boundary = BOUNDARY_DEAD; // BOUNDARY_DEAD, BOUNDARY_TORUS or BOUNDARY_REFLECT
+int threads = 1; // Threads stepping the grid, 0 for one per CPU
+unsigned int seed = 1; // Seed of the random starting grid
+char filename[100] = "./data/grid.snap"; // Binary snapshot saved every save_frequency generations
+char resume_filename[100] = ""; // Snapshot or grid.txt dump to continue from, empty starts a random grid
+char rule_string[RULE_NAME_LENGTH] = "cyclic"; // "cyclic", "B3/S23", "B36/S23", "B2/S/C8", "B2/S34H", "R5,C0,M1,S34..58,B34..45,NM", ...
 
 
 
 int main(int argc, char const *argv[])
 {
-    // Initialize the window with the specified dimensions
-    initialize_window("Automaton", WINDOW_WIDTH, WINDOW_HEIGHT);
-    initialize_keyboard_state();
+    struct rule rule;
+    if (parse_rule(rule_string, &rule) != 0) {
+        return 1;
+    }
+    if (rule.states) {
+        states = rule.states; // B/S and Generations rules fix their number of states
+    }
 
     struct grid grid;
     //struct color start = {255, 182, 193}; // Light Coral
@@ -43,18 +58,55 @@ int main(int argc, char const *argv[])
     //struct color end = {255, 255, 255}; // White
     
 
-    struct color* pallete = mallocpalette(states);
+    if (resume_filename[0]) {
+        struct snapshot_info info;
+        if (load_snapshot(&grid, &info, 0, resume_filename) != 0) {
+            return 1;
+        }
+        // Continuing under another rule would silently change the run
+        if (info.rule[0] && strcmp(info.rule, rule.name) != 0) {
+            fprintf(stderr, "%s was saved under %s, not %s; set rule_string to resume it\n", resume_filename,
+                    info.rule, rule.name);
+            return 1;
+        }
+        if (grid.states != states) {
+            fprintf(stderr, "%s has %d states, the rule needs %d\n", resume_filename, grid.states, states);
+            return 1;
+        }
+        seed = (unsigned int)info.seed;
+        initialize_gradient_palette(grid.palette, &start, &end, states);
+    } else {
+        struct color* pallete = mallocpalette(states);
+
+        initialize_gradient_palette(pallete, &start, &end, states);
+        allocate_grid(&grid, GRID_WIDTH, GRID_HEIGHT, states, pallete);
+        grid.boundary = boundary;
+    }
+    if (threads != 1) {
+        grid.pool = create_thread_pool(threads);
+    }
+    if (!resume_filename[0]) {
+        initialize_random_grid(&grid, grid.grid1, seed); // Filled on the pool, the same for any thread count
+    }
 
-    initialize_gradient_palette(pallete, &start, &end, states);
-    initialize_grid(&grid, GRID_WIDTH, GRID_HEIGHT, states, pallete); 
+    // Initialize the window with the grid's dimensions
+    initialize_window("Automaton", grid.width * CELL_SIZE, grid.height * CELL_SIZE);
+    initialize_keyboard_state();
 
+    // The grid steps on its own thread; this loop only shows its newest frame
+    struct grid_texture *texture = create_grid_texture(&grid);
+    struct simulation *simulation = start_simulation(&grid, &rule, delay_ms);
+    struct checkpoint_writer *checkpoints = create_checkpoint_writer(&grid, 2, 0); // Drops saves rather than stall the display
     int paused = 0;
+    uint64_t last_save = grid.generation / save_frequency;
+    int overlay_shown = 0;
 
     while (should_continue) {
         handle_events();
 
         if (is_key_down(SDL_SCANCODE_P)) {
             paused = !paused;  // Toggle pause
+            set_simulation_paused(simulation, paused);
         }
 
         if (is_key_down(SDL_SCANCODE_ESCAPE)) {
@@ -62,30 +114,56 @@ int main(int argc, char const *argv[])
         }
 
         if (is_key_down(SDL_SCANCODE_UP)) {
-            delay_ms = (delay_ms > 10) ? delay_ms - 10 : delay_ms; // Increase speed
+            delay_ms = (delay_ms > 10) ? delay_ms - 10 : 0; // Increase speed, 0 runs uncapped
+            set_simulation_delay(simulation, delay_ms);
         }
         if (is_key_down(SDL_SCANCODE_DOWN)) {
             delay_ms += 10; // Decrease speed
+            set_simulation_delay(simulation, delay_ms);
         }
 
-        if (!paused) {
+        struct grid frame;
+        uint64_t generation;
+        int fresh = latest_frame(simulation, &frame, &generation);
+        if (fresh || show_overlay != overlay_shown) {
+            overlay_shown = show_overlay;
             clear_window();
-            
-            update_grid(&grid, cyclic_rule); // Update the grid state
-            draw_grid(&grid); // Draw the grid
-            
+            PROFILE_BEGIN(PHASE_RENDER);
+            render_grid(texture, &frame); // Draw the newest generation
+            if (show_overlay) {
+                draw_profile_overlay(4, 4, 2);
+            }
+            PROFILE_END(PHASE_RENDER);
+            PROFILE_BEGIN(PHASE_PRESENT);
             present_window();
+            PROFILE_END(PHASE_PRESENT);
+        }
 
-            iterations++;
-            if (iterations % save_frequency == 0) {
-                write_grid_to_file(&grid, filename); // Save the current grid to file
+        if (fresh) {
+            iterations = (int)generation;
+            if (generation / save_frequency != last_save) {
+                last_save = generation / save_frequency;
+                PROFILE_BEGIN(PHASE_CHECKPOINT);
+                checkpoint_grid(checkpoints, &frame, &rule, seed, filename); // Save the current grid to file in the background
+                PROFILE_END(PHASE_CHECKPOINT);
             }
+        } else {
+            SDL_Delay(1); // Wait for the next generation
         }
+    }
+
+    stop_simulation(simulation);
 
-        SDL_Delay(delay_ms); // Control the frame rate
+    struct checkpoint_stats stats;
+    destroy_checkpoint_writer(checkpoints, &stats);
+    if (stats.dropped > 0) {
+        printf("Dropped %llu of %llu checkpoints while the writer was busy\n",
+               (unsigned long long)stats.dropped, (unsigned long long)stats.submitted);
     }
 
     // Free the grid memory before exiting
+    destroy_grid_texture(texture);
+    destroy_thread_pool(grid.pool);
     free_grid(&grid);
 
     return 0;
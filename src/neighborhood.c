@@ -0,0 +1,206 @@
+#include "neighborhood.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void *malloc_neighborhood(size_t size) {
+    void *data = calloc(1, size);
+    if (!data) {
+        fprintf(stderr, "Memory allocation failed for neighborhood window!\n");
+        exit(1);
+    }
+    return data;
+}
+
+// Index i of a row or column of n cells once the boundary mode is applied,
+// or -1 past a dead edge. Reflection mirrors about the edge, so -1 is cell 0
+// as in the halo.
+static int boundary_index(int i, int n, int boundary) {
+    if (i >= 0 && i < n) return i;
+    if (boundary == BOUNDARY_TORUS) {
+        return ((i % n) + n) % n;
+    }
+    if (boundary == BOUNDARY_REFLECT) {
+        int period = 2 * n;
+        int j = ((i % period) + period) % period;
+        return (j < n) ? j : period - 1 - j;
+    }
+    return -1;
+}
+
+// Whether cell (x, y) is live, wherever it lies around the grid
+static inline int live_at(const struct grid *grid, const uint8_t *cells, int x, int y) {
+    if (x >= -1 && x <= grid->width && y >= -1 && y <= grid->height) {
+        return get_cell(grid, cells, x, y) == 1;
+    }
+    x = boundary_index(x, grid->width, grid->boundary);
+    y = boundary_index(y, grid->height, grid->boundary);
+    return x >= 0 && y >= 0 && get_cell(grid, cells, x, y) == 1;
+}
+
+// Replace the prefix sums in sums with those of span cells of row y from
+// column first, and update the window total by the difference
+static void slide_row(const struct grid *grid, const uint8_t *cells, int y, int first, int span,
+                      int32_t *sums, int32_t *window) {
+    int32_t total = 0;
+    for (int k = 0; k < span; k++) {
+        total += live_at(grid, cells, first + k, y);
+        window[k + 1] += total - sums[k + 1];
+        sums[k + 1] = total;
+    }
+}
+
+// Next state of a cell from its live neighbor count, like build_table
+static inline int next_state(const struct rule *rule, int state, int count) {
+    if (rule->kind == RULE_LIFE_LIKE) {
+        return rule->table[state][count];
+    }
+    if (state == 1) {
+        int kept = count >= rule->survive_min && count <= rule->survive_max;
+        return kept ? 1 : (rule->states > 2 ? 2 : 0);
+    }
+    if (state > 1 && state < rule->states) {
+        return (state + 1) % rule->states;
+    }
+    return count >= rule->birth_min && count <= rule->birth_max;
+}
+
+// Step cells x0 to x1 of rows y0 to y1, carrying on from where the window
+// stopped when it covers the same cells and columns and ended at row y0, and
+// starting afresh otherwise. The window holds the prefix sums of rows
+// y - radius to y + radius, row r in slot (r - base) % (2 * radius + 1), and
+// window[k] is their total over the first k cells from x0 - radius.
+int step_neighborhood_window(struct neighborhood_window *window, const struct grid *grid, const struct rule *rule,
+                             const uint8_t *cells, uint8_t *next, int x0, int x1, int y0, int y1) {
+    const struct neighborhood *neighborhood = &rule->neighborhood;
+    int radius = neighborhood->radius;
+    int rows = 2 * radius + 1;
+    int first = x0 - radius, span = x1 - x0 + 2 * radius;
+    size_t row_sums = (size_t)span + 1;
+
+    if (window->cells != cells || window->x0 != x0 || window->x1 != x1 || window->radius != radius
+        || window->y != y0) {
+        size_t size = (size_t)(rows + 1) * row_sums;
+        if (size > window->capacity) {
+            free(window->prefix);
+            window->prefix = malloc_neighborhood(size * sizeof(int32_t));
+            window->capacity = size;
+        } else {
+            memset(window->prefix, 0, size * sizeof(int32_t));
+        }
+        window->sums = window->prefix + (size_t)rows * row_sums;
+        window->cells = cells;
+        window->x0 = x0;
+        window->x1 = x1;
+        window->radius = radius;
+        window->base = y0 - radius;
+        for (int y = y0 - radius; y < y0 + radius; y++) {
+            slide_row(grid, cells, y, first, span, window->prefix + (size_t)(y - window->base) * row_sums,
+                      window->sums);
+        }
+    }
+
+    int32_t *prefix = window->prefix;
+    const int32_t *totals = window->sums;
+    const int32_t *sums[2 * MAX_RADIUS + 1];   // Rows y - radius to y + radius
+    int changed = 0;
+
+    for (int y = y0; y < y1; y++) {
+        // Row y + radius takes the slot of row y - radius - 1, which just left the window
+        int slot = (y + radius - window->base) % rows;
+        slide_row(grid, cells, y + radius, first, span, prefix + (size_t)slot * row_sums, window->sums);
+        for (int dy = -radius; dy <= radius; dy++) {
+            sums[dy + radius] = prefix + (size_t)((y + dy - window->base) % rows) * row_sums;
+        }
+        const int32_t *mid = sums[radius];
+
+        for (int x = x0; x < x1; x++) {
+            int k = x - x0 + radius;    // Index of the cell in the window's rows
+            int self = mid[k + 1] - mid[k];
+            int count;
+            switch (neighborhood->kind) {
+                case NEIGHBORHOOD_VON_NEUMANN:
+                    count = 0;
+                    for (int dy = -radius; dy <= radius; dy++) {
+                        int reach = radius - abs(dy);
+                        count += sums[dy + radius][k + reach + 1] - sums[dy + radius][k - reach];
+                    }
+                    break;
+                case NEIGHBORHOOD_HEXAGONAL:
+                    count = totals[k + 2] - totals[k - 1]
+                          - (sums[0][k + 2] - sums[0][k + 1]) - (sums[2][k] - sums[2][k - 1]);
+                    break;
+                case NEIGHBORHOOD_WEIGHTED:
+                    count = 0;
+                    for (int dy = -radius; dy <= radius; dy++) {
+                        const int8_t *weights = neighborhood->weights[MAX_WEIGHT_RADIUS + dy] + MAX_WEIGHT_RADIUS;
+                        for (int dx = -radius; dx <= radius; dx++) {
+                            count += weights[dx] * (sums[dy + radius][k + dx + 1] - sums[dy + radius][k + dx]);
+                        }
+                    }
+                    self = 0;   // The weights say whether the cell counts itself
+                    break;
+                default:
+                    count = totals[k + radius + 1] - totals[k - radius];
+                    break;
+            }
+            if (!neighborhood->include_center) {
+                count -= self;
+            }
+
+            int state = get_cell(grid, cells, x, y);
+            int result = next_state(rule, state, count);
+            changed |= result != state;
+            set_cell(grid, next, x, y, result);
+        }
+    }
+    window->y = y1;
+    return changed;
+}
+
+void free_neighborhood_window(struct neighborhood_window *window) {
+    free(window->prefix);
+    *window = (struct neighborhood_window){0};
+}
+
+// Step a block of cells with a window of its own
+int neighborhood_kernel(const struct grid *grid, const struct rule *rule, const uint8_t *cells,
+                        uint8_t *next, int x0, int x1, int y0, int y1) {
+    struct neighborhood_window window = {0};
+    int changed = step_neighborhood_window(&window, grid, rule, cells, next, x0, x1, y0, y1);
+    free_neighborhood_window(&window);
+    return changed;
+}
+
+// Whether a rule counts anything other than the 3x3 Moore square
+int uses_neighborhood_kernel(const struct rule *rule) {
+    return rule->kind == RULE_RANGES || rule->neighborhood.kind != NEIGHBORHOOD_MOORE;
+}
+
+// Live cells in a neighborhood of cell (x, y), one at a time, for rule
+// callbacks. Counts the same as the kernel.
+int count_neighborhood(int x, int y, const uint8_t *cells, const struct grid *grid,
+                       const struct neighborhood *neighborhood) {
+    int radius = neighborhood->radius;
+    int count = 0;
+    for (int dy = -radius; dy <= radius; dy++) {
+        for (int dx = -radius; dx <= radius; dx++) {
+            int weight;
+            switch (neighborhood->kind) {
+                case NEIGHBORHOOD_VON_NEUMANN: weight = abs(dx) + abs(dy) <= radius; break;
+                case NEIGHBORHOOD_HEXAGONAL: weight = !((dx == 1 && dy == -1) || (dx == -1 && dy == 1)); break;
+                case NEIGHBORHOOD_WEIGHTED:
+                    weight = neighborhood->weights[MAX_WEIGHT_RADIUS + dy][MAX_WEIGHT_RADIUS + dx];
+                    break;
+                default: weight = 1; break;
+            }
+            if (dx == 0 && dy == 0 && neighborhood->kind != NEIGHBORHOOD_WEIGHTED) {
+                weight = neighborhood->include_center;
+            }
+            if (weight) {
+                count += weight * live_at(grid, cells, x + dx, y + dy);
+            }
+        }
+    }
+    return count;
+}
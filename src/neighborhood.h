@@ -0,0 +1,41 @@
+#ifndef NEIGHBORHOOD_H
+#define NEIGHBORHOOD_H
+
+#include "grid.h"
+#include "rule.h"
+
+// Counting neighbors beyond the 3x3 Moore square. The kernel slides a window
+// of 2 * radius + 1 rows down its band, keeping each row's prefix sums of
+// live cells and their sum over the window, a summed-area table of just the
+// rows in reach. A Moore count is then two lookups however large the radius,
+// a von Neumann count one pair per row of the diamond, and a weighted count
+// one lookup per weight. Cells out to a distance of one come from the halo
+// like in every other kernel; farther out the boundary mode is applied
+// directly.
+//
+// A window can be carried from one block of rows to the next one below it,
+// so a thread stepping its band a few rows at a time builds it only once.
+
+// The rows of prefix sums around the row being stepped, and where they are
+struct neighborhood_window {
+    int32_t *prefix;        // 2 * radius + 1 rows of prefix sums, then their totals
+    int32_t *sums;          // The totals, within prefix
+    size_t capacity;        // int32_t values prefix has room for
+    const uint8_t *cells;   // Buffer the sums are of, NULL before the first block
+    int x0, x1, radius;
+    int base;               // Row kept in the first slot
+    int y;                  // Row the window carries on from
+};
+
+int step_neighborhood_window(struct neighborhood_window *window, const struct grid *grid, const struct rule *rule,
+                             const uint8_t *cells, uint8_t *next, int x0, int x1, int y0, int y1);
+void free_neighborhood_window(struct neighborhood_window *window);
+
+int neighborhood_kernel(const struct grid *grid, const struct rule *rule, const uint8_t *cells,
+                        uint8_t *next, int x0, int x1, int y0, int y1);
+int uses_neighborhood_kernel(const struct rule *rule);
+
+int count_neighborhood(int x, int y, const uint8_t *cells, const struct grid *grid,
+                       const struct neighborhood *neighborhood);
+
+#endif
@@ -0,0 +1,79 @@
+#include "overlay.h"
+#include "gui.h"
+#include "profile.h"
+#include <ctype.h>
+
+#define GLYPH_WIDTH 3
+#define GLYPH_HEIGHT 5
+#define OVERLAY_COLUMNS 46     // Characters in the widest overlay line
+
+// 3x5 bitmap font, rows from the top, '1' for a lit pixel
+static const char *glyphs[128] = {
+    ['0'] = "111101101101111", ['1'] = "010110010010111", ['2'] = "111001111100111",
+    ['3'] = "111001111001111", ['4'] = "101101111001001", ['5'] = "111100111001111",
+    ['6'] = "111100111101111", ['7'] = "111001001001001", ['8'] = "111101111101111",
+    ['9'] = "111101111001111",
+    ['A'] = "010101111101101", ['B'] = "110101110101110", ['C'] = "011100100100011",
+    ['D'] = "110101101101110", ['E'] = "111100110100111", ['F'] = "111100110100100",
+    ['G'] = "011100101101011", ['H'] = "101101111101101", ['I'] = "111010010010111",
+    ['J'] = "001001001101010", ['K'] = "101101110101101", ['L'] = "100100100100111",
+    ['M'] = "101111111101101", ['N'] = "110101101101101", ['O'] = "010101101101010",
+    ['P'] = "110101110100100", ['Q'] = "010101101110011", ['R'] = "110101110101101",
+    ['S'] = "011100010001110", ['T'] = "111010010010010", ['U'] = "101101101101111",
+    ['V'] = "101101101101010", ['W'] = "101101111111101", ['X'] = "101101010101101",
+    ['Y'] = "101101010010010", ['Z'] = "111001010100111",
+    ['.'] = "000000000000010", [':'] = "000010000010000", ['-'] = "000000111000000",
+    ['/'] = "001001010100100", ['%'] = "101001010100101",
+};
+
+// Draw text in the current color, one filled rectangle per lit pixel.
+// Lowercase letters are drawn as capitals, unknown characters as spaces.
+void draw_text(const char *text, int x, int y, int scale) {
+    for (; *text; text++, x += (GLYPH_WIDTH + 1) * scale) {
+        unsigned char c = (unsigned char)toupper((unsigned char)*text);
+        const char *glyph = (c < 128) ? glyphs[c] : NULL;
+        if (!glyph) continue;
+        for (int row = 0; row < GLYPH_HEIGHT; row++) {
+            for (int column = 0; column < GLYPH_WIDTH; column++) {
+                if (glyph[row * GLYPH_WIDTH + column] == '1') {
+                    draw_rectangle(x + column * scale, y + row * scale, scale, scale);
+                }
+            }
+        }
+    }
+}
+
+// Rolling timings of every phase with samples, on a dark translucent panel
+void draw_profile_overlay(int x, int y, int scale) {
+    int line_height = (GLYPH_HEIGHT + 2) * scale;
+    char line[96];
+    int lines = 1;
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        struct phase_stats stats;
+        get_phase_stats(phase, &stats);
+        lines += (stats.count > 0);
+    }
+
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    set_color(0, 0, 0, 180);
+    draw_rectangle(x, y, (OVERLAY_COLUMNS * (GLYPH_WIDTH + 1) + 1) * scale, lines * line_height + 2 * scale);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+    set_color(255, 255, 255, 255);
+
+    x += scale;
+    y += 2 * scale;
+    if (!profiling_enabled()) {
+        draw_text("built without profiling", x, y, scale);
+        return;
+    }
+    draw_text("phase        p50 ms   p90 ms   p99 ms   max ms", x, y, scale);
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        struct phase_stats stats;
+        get_phase_stats(phase, &stats);
+        if (stats.count == 0) continue;
+        y += line_height;
+        snprintf(line, sizeof(line), "%-10s %8.3f %8.3f %8.3f %8.3f", phase_name(phase), stats.p50_ms,
+                 stats.p90_ms, stats.p99_ms, stats.max_ms);
+        draw_text(line, x, y, scale);
+    }
+}
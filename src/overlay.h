@@ -0,0 +1,7 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+void draw_text(const char *text, int x, int y, int scale);
+void draw_profile_overlay(int x, int y, int scale);
+
+#endif
@@ -0,0 +1,122 @@
+#include "pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct worker_start {
+    struct thread_pool *pool;
+    int thread;
+};
+
+// Worker loop: wait for a new round, run the task, report back
+static void *worker_main(void *data) {
+    struct worker_start *start = data;
+    struct thread_pool *pool = start->pool;
+    int thread = start->thread;
+    free(start);
+
+    unsigned long seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->round == seen && !pool->stopping) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->stopping) break;
+        seen = pool->round;
+        pool_task task = pool->task;
+        void *arg = pool->arg;
+        pthread_mutex_unlock(&pool->lock);
+
+        task(arg, thread, pool->threads);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Start a pool of threads, counting the caller. Threads below 1 mean one per CPU.
+struct thread_pool *create_thread_pool(int threads) {
+    struct thread_pool *pool = calloc(1, sizeof(struct thread_pool));
+    if (!pool) {
+        fprintf(stderr, "Memory allocation failed for thread pool!\n");
+        exit(1);
+    }
+    pool->threads = (threads < 1) ? available_cpus() : threads;
+    pool->workers = calloc(pool->threads, sizeof(pthread_t));
+    if (!pool->workers) {
+        fprintf(stderr, "Memory allocation failed for thread pool!\n");
+        exit(1);
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (int i = 1; i < pool->threads; i++) {
+        struct worker_start *start = malloc(sizeof(struct worker_start));
+        if (!start) {
+            fprintf(stderr, "Memory allocation failed for thread pool!\n");
+            exit(1);
+        }
+        start->pool = pool;
+        start->thread = i;
+        if (pthread_create(&pool->workers[i], NULL, worker_main, start) != 0) {
+            fprintf(stderr, "Could not start worker thread %d!\n", i);
+            exit(1);
+        }
+    }
+    return pool;
+}
+
+// Stop and join all workers, then free the pool
+void destroy_thread_pool(struct thread_pool *pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 1; i < pool->threads; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->workers);
+    free(pool);
+}
+
+// Run a task on every thread of the pool and wait until all of them are done.
+// The return is the pool's only barrier.
+void run_on_pool(struct thread_pool *pool, pool_task task, void *arg) {
+    if (pool->threads == 1) {
+        task(arg, 0, 1);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->arg = arg;
+    pool->pending = pool->threads - 1;
+    pool->round++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    task(arg, 0, pool->threads);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Number of CPUs online, at least 1
+int available_cpus(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return (cpus < 1) ? 1 : (int)cpus;
+}
@@ -0,0 +1,29 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+
+// A task runs once on every thread of the pool; thread is 0 to threads - 1
+typedef void (*pool_task)(void *arg, int thread, int threads);
+
+// Persistent worker threads. The thread calling run_on_pool takes part as
+// thread 0, so a pool of n threads starts n - 1 workers.
+struct thread_pool {
+    int threads;
+    pthread_t *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    pool_task task;
+    void *arg;
+    unsigned long round;    // Incremented every time a task is handed out
+    int pending;            // Workers still busy with the current round
+    int stopping;
+};
+
+struct thread_pool *create_thread_pool(int threads);
+void destroy_thread_pool(struct thread_pool *pool);
+void run_on_pool(struct thread_pool *pool, pool_task task, void *arg);
+int available_cpus(void);
+
+#endif
@@ -0,0 +1,100 @@
+#include "profile.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
+struct profile_ring {
+    atomic_uint_fast64_t count;
+    atomic_uint samples[PROFILE_SAMPLES];   // Nanoseconds, saturating at about 4 s
+};
+
+static struct profile_ring rings[PHASE_COUNT];
+
+uint64_t profile_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void profile_record(int phase, uint64_t nanoseconds) {
+    struct profile_ring *ring = &rings[phase];
+    uint64_t slot = atomic_load_explicit(&ring->count, memory_order_relaxed) % PROFILE_SAMPLES;
+    atomic_store_explicit(&ring->samples[slot], nanoseconds > UINT32_MAX ? UINT32_MAX : (unsigned int)nanoseconds,
+                          memory_order_relaxed);
+    atomic_fetch_add_explicit(&ring->count, 1, memory_order_release);
+}
+
+// Record a span covering generations steps as that many samples of its mean
+void profile_record_each(int phase, uint64_t nanoseconds, uint64_t generations) {
+    if (generations == 0) return;
+    struct profile_ring *ring = &rings[phase];
+    uint64_t mean = nanoseconds / generations;
+    unsigned int sample = mean > UINT32_MAX ? UINT32_MAX : (unsigned int)mean;
+    uint64_t count = atomic_load_explicit(&ring->count, memory_order_relaxed);
+    uint64_t writes = generations < PROFILE_SAMPLES ? generations : PROFILE_SAMPLES;
+    for (uint64_t i = generations - writes; i < generations; i++) {
+        atomic_store_explicit(&ring->samples[(count + i) % PROFILE_SAMPLES], sample, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&ring->count, generations, memory_order_release);
+}
+
+static int compare_samples(const void *a, const void *b) {
+    unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+    return (x > y) - (x < y);
+}
+
+// Figures over the phase's most recent samples
+void get_phase_stats(int phase, struct phase_stats *stats) {
+    struct profile_ring *ring = &rings[phase];
+    unsigned int samples[PROFILE_SAMPLES];
+
+    stats->count = atomic_load_explicit(&ring->count, memory_order_acquire);
+    stats->window = (stats->count < PROFILE_SAMPLES) ? (int)stats->count : PROFILE_SAMPLES;
+    if (stats->window == 0) {
+        stats->mean_ms = stats->p50_ms = stats->p90_ms = stats->p99_ms = stats->max_ms = 0;
+        return;
+    }
+
+    double total = 0;
+    for (int i = 0; i < stats->window; i++) {
+        samples[i] = atomic_load_explicit(&ring->samples[i], memory_order_relaxed);
+        total += samples[i];
+    }
+    qsort(samples, stats->window, sizeof(samples[0]), compare_samples);
+    stats->mean_ms = total / stats->window * 1e-6;
+    stats->p50_ms = samples[(stats->window - 1) * 50 / 100] * 1e-6;
+    stats->p90_ms = samples[(stats->window - 1) * 90 / 100] * 1e-6;
+    stats->p99_ms = samples[(stats->window - 1) * 99 / 100] * 1e-6;
+    stats->max_ms = samples[stats->window - 1] * 1e-6;
+}
+
+const char *phase_name(int phase) {
+    static const char *names[PHASE_COUNT] = {"step", "render", "present", "checkpoint", "save", "record"};
+    return (phase >= 0 && phase < PHASE_COUNT) ? names[phase] : "?";
+}
+
+int profiling_enabled(void) {
+#ifdef PROFILING
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+// One line per phase that has samples, as whitespace-separated columns
+void write_profile_stats(FILE *file) {
+    if (!profiling_enabled()) {
+        fprintf(file, "# built without PROFILING, no timings\n");
+        return;
+    }
+    fprintf(file, "%-10s %10s %6s %10s %10s %10s %10s %10s\n", "phase", "count", "window", "mean_ms", "p50_ms",
+            "p90_ms", "p99_ms", "max_ms");
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        struct phase_stats stats;
+        get_phase_stats(phase, &stats);
+        if (stats.count == 0) continue;
+        fprintf(file, "%-10s %10llu %6d %10.3f %10.3f %10.3f %10.3f %10.3f\n", phase_name(phase),
+                (unsigned long long)stats.count, stats.window, stats.mean_ms, stats.p50_ms, stats.p90_ms,
+                stats.p99_ms, stats.max_ms);
+    }
+}
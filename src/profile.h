@@ -0,0 +1,55 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Per-phase timers for the main loop. Each phase keeps its last
+// PROFILE_SAMPLES durations in a ring, from which percentiles are taken on
+// demand. A phase is timed by one thread at a time, while any thread may read
+// it. PROFILE_END_EACH ends a span stepping several generations at once as
+// one sample per generation, so PHASE_STEP is always per generation.
+// PROFILE_BEGIN and the PROFILE_END macros compile to nothing unless
+// PROFILING is defined (make PROFILE=1).
+
+#define PROFILE_SAMPLES 256
+
+enum profile_phase {
+    PHASE_STEP,         // Stepping the grid
+    PHASE_RENDER,       // Converting and drawing a frame
+    PHASE_PRESENT,      // Presenting it, including any vsync wait
+    PHASE_CHECKPOINT,   // Handing a checkpoint to the writer
+    PHASE_SAVE,         // The writer saving it
+    PHASE_RECORD,       // Appending a generation to a recording
+    PHASE_COUNT
+};
+
+struct phase_stats {
+    uint64_t count;     // Samples ever recorded
+    int window;         // Samples the figures below are taken from
+    double mean_ms;
+    double p50_ms;
+    double p90_ms;
+    double p99_ms;
+    double max_ms;
+};
+
+#ifdef PROFILING
+#define PROFILE_BEGIN(phase) uint64_t profile_begin_##phase = profile_now()
+#define PROFILE_END(phase) profile_record(phase, profile_now() - profile_begin_##phase)
+#define PROFILE_END_EACH(phase, n) profile_record_each(phase, profile_now() - profile_begin_##phase, n)
+#else
+#define PROFILE_BEGIN(phase) ((void)0)
+#define PROFILE_END(phase) ((void)0)
+#define PROFILE_END_EACH(phase, n) ((void)0)
+#endif
+
+uint64_t profile_now(void);
+void profile_record(int phase, uint64_t nanoseconds);
+void profile_record_each(int phase, uint64_t nanoseconds, uint64_t generations);
+void get_phase_stats(int phase, struct phase_stats *stats);
+const char *phase_name(int phase);
+int profiling_enabled(void);
+void write_profile_stats(FILE *file);
+
+#endif
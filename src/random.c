@@ -0,0 +1,89 @@
+#include "random.h"
+#include "pool.h"
+
+// Bit grids take a whole word per 64 cells. Byte grids map every 8 random
+// bits to a state when states divide 256, and every 16 bits otherwise,
+// with a multiply and shift in place of a division.
+
+// Stream of row y, the palette uses the one before the first row
+#define PALETTE_STREAM UINT64_MAX
+
+struct fill_job {
+    struct grid *grid;
+    uint8_t *cells;
+    uint64_t seed;
+};
+
+static void fill_bit_row(const struct grid *grid, uint8_t *cells, int y, uint64_t seed) {
+    uint64_t *row = (uint64_t *)grid_row(grid, cells, y);
+    size_t words = grid->stride / sizeof(uint64_t);
+    size_t last = (size_t)grid->width; // Bit of the last cell, bit 0 is the left halo
+    for (size_t i = 0; i < words; i++) {
+        uint64_t bits = random_word(seed, (uint64_t)y, i);
+        if (i == 0) {
+            bits &= ~(uint64_t)1;
+        }
+        if (last < i * 64) {
+            bits = 0;
+        } else if (last < i * 64 + 63) {
+            bits &= ((uint64_t)2 << (last - i * 64)) - 1;
+        }
+        row[i] = bits;
+    }
+}
+
+static void fill_byte_row(const struct grid *grid, uint8_t *cells, int y, uint64_t seed) {
+    uint8_t *row = grid_row(grid, cells, y) + 1;
+    uint32_t states = (uint32_t)grid->states;
+    int width = grid->width;
+    if (256 % states == 0) {
+        for (int x = 0, i = 0; x < width; x += 8, i++) {
+            uint64_t bits = random_word(seed, (uint64_t)y, (uint64_t)i);
+            int end = (width - x < 8) ? width - x : 8;
+            for (int k = 0; k < end; k++, bits >>= 8) {
+                row[x + k] = (uint8_t)(((bits & 0xFF) * states) >> 8);
+            }
+        }
+    } else {
+        for (int x = 0, i = 0; x < width; x += 4, i++) {
+            uint64_t bits = random_word(seed, (uint64_t)y, (uint64_t)i);
+            int end = (width - x < 4) ? width - x : 4;
+            for (int k = 0; k < end; k++, bits >>= 16) {
+                row[x + k] = (uint8_t)(((bits & 0xFFFF) * states) >> 16);
+            }
+        }
+    }
+}
+
+static void fill_band(void *arg, int thread, int threads) {
+    struct fill_job *job = arg;
+    struct grid *grid = job->grid;
+    int y0 = (int)((long long)grid->height * thread / threads);
+    int y1 = (int)((long long)grid->height * (thread + 1) / threads);
+    for (int y = y0; y < y1; y++) {
+        if (grid->format == CELL_FORMAT_BITS) {
+            fill_bit_row(grid, job->cells, y, job->seed);
+        } else {
+            fill_byte_row(grid, job->cells, y, job->seed);
+        }
+    }
+}
+
+// Fill every cell with a uniformly random state, on the grid's pool if it has one
+void fill_random_cells(struct grid *grid, uint8_t *cells, uint64_t seed) {
+    struct fill_job job = {grid, cells, seed};
+    if (grid->pool && grid->pool->threads > 1) {
+        run_on_pool(grid->pool, fill_band, &job);
+    } else {
+        fill_band(&job, 0, 1);
+    }
+}
+
+void fill_random_palette(struct color *palette, int total_states, uint64_t seed) {
+    for (int i = 0; i < total_states; i++) {
+        uint64_t bits = random_word(seed, PALETTE_STREAM, (uint64_t)i);
+        palette[i].red = (int)(bits & 0xFF);
+        palette[i].green = (int)((bits >> 8) & 0xFF);
+        palette[i].blue = (int)((bits >> 16) & 0xFF);
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+#include "grid.h"
+
+// Counter-based random numbers: word i of stream s under a seed is a pure
+// function of (seed, s, i), so any thread can produce any part of the
+// sequence without shared state. Grids use one stream per row, which makes
+// a random fill identical for a given seed whatever the number of threads.
+
+// SplitMix64 finalizer, a bijective 64-bit mix
+static inline uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t random_word(uint64_t seed, uint64_t stream, uint64_t counter) {
+    uint64_t key = mix64(seed + 0x9E3779B97F4A7C15ULL);
+    return mix64(key + stream * 0xD1B54A32D192ED03ULL + counter * 0x9E3779B97F4A7C15ULL);
+}
+
+void fill_random_cells(struct grid *grid, uint8_t *cells, uint64_t seed);
+void fill_random_palette(struct color *palette, int total_states, uint64_t seed);
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <stdio.h>
+#include "grid.h"
+#include "rule.h"
+
+#define RECORDING_MAGIC "CAREC\r\n"
+#define RECORDING_INDEX_MAGIC "CAINDEX"
+#define RECORDING_VERSION 1
+
+// A recording is one file holding every recorded generation of a run:
+//
+//   recording_header
+//   frames, each a recording_frame followed by its payload
+//   index: recording_index_entry per frame, then a recording_trailer
+//
+// Keyframes store the rows of a generation, deltas store the XOR against the
+// generation recorded before, tile by tile (the activity tiles of grid.h),
+// leaving out tiles that did not change. Both are run-length encoded as
+// pairs of varints (zero bytes to skip, literal bytes to follow) with the
+// literal bytes after each pair. The index at the end lets a reader seek;
+// a recording that was never finished is indexed by scanning its frames.
+struct recording_header {
+    char magic[8];              // RECORDING_MAGIC
+    uint32_t version;           // RECORDING_VERSION
+    uint32_t header_bytes;
+    uint32_t width;
+    uint32_t height;
+    uint32_t states;
+    uint8_t format;             // enum cell_format
+    uint8_t boundary;           // enum boundary_mode
+    uint16_t reserved;
+    uint64_t stride;
+    uint32_t keyframe_interval;
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+    uint32_t reserved2;
+    uint64_t seed;
+    char rule[RULE_NAME_LENGTH];
+};
+
+enum recording_frame_kind {
+    FRAME_KEYFRAME,
+    FRAME_DELTA
+};
+
+struct recording_frame {
+    uint64_t generation;
+    uint32_t kind;              // enum recording_frame_kind
+    uint32_t tiles;             // Tiles in a delta, 0 for keyframes
+    uint64_t payload_bytes;
+};
+
+struct recording_index_entry {
+    uint64_t generation;
+    uint64_t offset;            // Of the frame's recording_frame
+    uint32_t kind;
+    uint32_t reserved;
+};
+
+struct recording_trailer {
+    char magic[8];              // RECORDING_INDEX_MAGIC
+    uint64_t index_offset;
+    uint64_t frames;
+};
+
+// Growable byte buffer for encoded frames
+struct byte_buffer {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+};
+
+struct recorder {
+    FILE *file;
+    struct recording_header header;
+    uint8_t *previous;          // Rows of the last recorded generation
+    uint8_t *cell_mask;         // Row bytes or bits that hold cells, not halo or padding
+    uint64_t previous_generation;
+    uint64_t frames;
+    struct byte_buffer payload;
+    struct byte_buffer keyframe;    // Keyframe encoding when a delta grows too big
+    size_t keyframe_bytes;          // Payload of the last keyframe
+    uint8_t *tile_scratch;
+    struct recording_index_entry *index;
+    size_t index_capacity;
+    uint64_t bytes_written;
+};
+
+struct recording {
+    FILE *file;
+    struct recording_header header;
+    struct recording_index_entry *index;
+    uint64_t frames;
+    struct grid grid;           // The decoded generation
+    int64_t decoded;            // Index of the frame in grid, -1 for none
+    struct byte_buffer payload;
+    uint8_t *tile_scratch;
+};
+
+struct recorder *start_recording(const struct grid *grid, const struct rule *rule, uint64_t seed,
+                                 int keyframe_interval, const char *filename);
+int record_generation(struct recorder *recorder, const struct grid *grid);
+int finish_recording(struct recorder *recorder);
+
+struct recording *open_recording(const char *filename);
+void close_recording(struct recording *recording);
+const struct grid *seek_recording(struct recording *recording, uint64_t generation);
+
+struct snapshot_info;
+int is_recording(const char *filename);
+int load_recorded_generation(struct grid *grid, struct snapshot_info *info, uint64_t generation,
+                             const char *filename);
+
+#endif
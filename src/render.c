@@ -0,0 +1,116 @@
+#include "render.h"
+#include "activity.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Texture for a grid, with its palette converted to pixels
+struct grid_texture *create_grid_texture(struct grid *grid) {
+    struct grid_texture *texture = malloc(sizeof(struct grid_texture));
+    if (!texture) {
+        fprintf(stderr, "Memory allocation failed for grid texture!\n");
+        exit(1);
+    }
+    texture->pixels = malloc((size_t)grid->width * grid->height * sizeof(uint32_t));
+    if (!texture->pixels) {
+        fprintf(stderr, "Memory allocation failed for grid texture!\n");
+        exit(1);
+    }
+
+    texture->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                         grid->width, grid->height);
+    if (!texture->texture) {
+        printf("Could not create grid texture: %s\n", SDL_GetError());
+        exit(1);
+    }
+
+    for (int state = 0; state <= MAX_STATES; state++) {
+        struct color col = (state < grid->states) ? grid->palette[state] : (struct color){0, 0, 0};
+        texture->colors[state] = 0xFF000000u | (uint32_t)col.red << 16 | (uint32_t)col.green << 8 | (uint32_t)col.blue;
+    }
+    texture->width = grid->width;
+    texture->height = grid->height;
+    texture->complete = 0;
+    return texture;
+}
+
+void destroy_grid_texture(struct grid_texture *texture) {
+    if (!texture) return;
+    SDL_DestroyTexture(texture->texture);
+    free(texture->pixels);
+    free(texture);
+}
+
+// Convert and upload the whole grid on the next frame, for when the grid
+// advanced more than one generation since the last one was drawn
+void invalidate_grid_texture(struct grid_texture *texture) {
+    texture->complete = 0;
+}
+
+// Map cells [x0, x1) x [y0, y1) to pixels
+static void convert_cells(struct grid_texture *texture, struct grid *grid, int x0, int x1, int y0, int y1) {
+    const uint8_t *cells = current_cells(grid);
+    const uint32_t *colors = texture->colors;
+
+    for (int y = y0; y < y1; y++) {
+        uint32_t *pixels = texture->pixels + (size_t)y * texture->width;
+        if (grid->format == CELL_FORMAT_BITS) {
+            const uint64_t *words = (const uint64_t *)grid_row(grid, cells, y);
+            uint32_t dead = colors[0], live = colors[1];
+            for (int x = x0; x < x1; x++) {
+                pixels[x] = ((words[(x + 1) >> 6] >> ((x + 1) & 63)) & 1) ? live : dead;
+            }
+        } else {
+            const uint8_t *row = grid_row(grid, cells, y) + 1;
+            for (int x = x0; x < x1; x++) {
+                pixels[x] = colors[row[x]];
+            }
+        }
+    }
+}
+
+// Draw the current generation scaled by CELL_SIZE. When the grid tracks
+// activity and the previous generation was drawn, only the changed tiles are
+// converted and uploaded; otherwise the whole grid is.
+void render_grid(struct grid_texture *texture, struct grid *grid) {
+    int count = 0;
+    const int *tiles = NULL;
+    if (grid->activity && texture->complete) {
+        tiles = changed_tiles(grid, &count);
+    }
+
+    // Past half the tiles one upload of everything is cheaper than many small ones
+    if (tiles && count < grid->activity->tiles_x * grid->activity->tiles_y / 2) {
+        for (int i = 0; i < count; i++) {
+            int x0, x1, y0, y1;
+            tile_bounds(grid, tiles[i], &x0, &x1, &y0, &y1);
+            convert_cells(texture, grid, x0, x1, y0, y1);
+            SDL_Rect rect = {x0, y0, x1 - x0, y1 - y0};
+            SDL_UpdateTexture(texture->texture, &rect, texture->pixels + (size_t)y0 * texture->width + x0,
+                              texture->width * (int)sizeof(uint32_t));
+        }
+    } else {
+        convert_cells(texture, grid, 0, grid->width, 0, grid->height);
+        SDL_UpdateTexture(texture->texture, NULL, texture->pixels, texture->width * (int)sizeof(uint32_t));
+    }
+    texture->complete = 1;
+
+    SDL_Rect target = {0, 0, grid->width * CELL_SIZE, grid->height * CELL_SIZE};
+    SDL_RenderCopy(renderer, texture->texture, NULL, &target);
+}
+
+// Draw a single cell using its color from the palette
+void draw_cell(int x, int y, int state, struct color *palette) {
+    struct color col = palette[state];
+    SDL_SetRenderDrawColor(renderer, col.red, col.green, col.blue, 255);
+    draw_rectangle(x * CELL_SIZE, y * CELL_SIZE, CELL_SIZE, CELL_SIZE);
+}
+
+// Draw the entire grid one rectangle per cell, the slow path render_grid replaces
+void draw_grid(struct grid *grid) {
+    const uint8_t *grid_current = current_cells(grid);
+    for (int y = 0; y < grid->height; y++) {
+        for (int x = 0; x < grid->width; x++) {
+            draw_cell(x, y, get_cell(grid, grid_current, x, y), grid->palette);
+        }
+    }
+}
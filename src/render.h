@@ -0,0 +1,28 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "gui.h"
+#include "grid.h"
+
+// Draws a grid through one streaming texture: states are mapped to pixels
+// through the palette, uploaded once per frame and scaled by CELL_SIZE in a
+// single copy. With activity tracking only the tiles that changed in the last
+// generation are converted and uploaded.
+struct grid_texture {
+    SDL_Texture *texture;
+    uint32_t *pixels;                   // ARGB8888, width pixels per row
+    uint32_t colors[MAX_STATES + 1];    // Palette entry of every state as a pixel
+    int width;
+    int height;
+    int complete;                       // Whether the texture holds a whole frame
+};
+
+struct grid_texture *create_grid_texture(struct grid *grid);
+void destroy_grid_texture(struct grid_texture *texture);
+void invalidate_grid_texture(struct grid_texture *texture);
+void render_grid(struct grid_texture *texture, struct grid *grid);
+
+void draw_cell(int x, int y, int state, struct color *palette);
+void draw_grid(struct grid *grid);
+
+#endif
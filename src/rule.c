@@ -0,0 +1,223 @@
+#include "rule.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+// Fill the transition table of a life-like rule from its birth and survival sets.
+// Generations rules (more than 2 states) send a dying cell through states
+// 2 to states - 1 before it returns to 0. Rows for states beyond the rule's
+// own count behave like dead cells, as the hand-written rules always did.
+static void build_table(struct rule *rule) {
+    for (int state = 0; state < MAX_STATES; state++) {
+        for (int n = 0; n < NEIGHBOR_COUNTS; n++) {
+            uint8_t next;
+            if (state == 1) {
+                next = rule->survive[n] ? 1 : (rule->states > 2 ? 2 : 0);
+            } else if (state > 1 && state < rule->states) {
+                next = (state + 1) % rule->states;
+            } else {
+                next = rule->birth[n] ? 1 : 0;
+            }
+            rule->table[state][n] = next;
+        }
+    }
+}
+
+// Parse a neighbor count list such as "236" into a set
+static const char *parse_counts(const char *text, uint8_t *set) {
+    while (isdigit((unsigned char)*text)) {
+        int n = *text - '0';
+        if (n >= NEIGHBOR_COUNTS) return NULL;
+        set[n] = 1;
+        text++;
+    }
+    return text;
+}
+
+// Parse a count range such as "34..58"
+static const char *parse_range(const char *text, int *min, int *max) {
+    char *end;
+    long low = strtol(text, &end, 10);
+    if (end == text || low < 0 || strncmp(end, "..", 2) != 0) return NULL;
+    text = end + 2;
+    long high = strtol(text, &end, 10);
+    if (end == text || high < low) return NULL;
+    *min = (int)low;
+    *max = (int)high;
+    return end;
+}
+
+// Parse the weights of a weighted neighborhood, one digit per cell of its
+// square, row by row
+static const char *parse_weights(const char *text, struct neighborhood *neighborhood) {
+    int side = 2 * neighborhood->radius + 1;
+    int offset = MAX_WEIGHT_RADIUS - neighborhood->radius;
+    for (int i = 0; i < side * side; i++) {
+        if (!isdigit((unsigned char)text[i])) return NULL;
+        neighborhood->weights[offset + i / side][offset + i % side] = (int8_t)(text[i] - '0');
+    }
+    return text + side * side;
+}
+
+// Parse a Larger than Life rule such as "R5,C0,M1,S34..58,B34..45,NM": the
+// radius, the states (C0 and C1 both mean 2), whether the cell counts
+// itself, the survival and birth ranges and the neighborhood, NM for Moore,
+// NN for von Neumann, NH for hexagonal or NW and one weight per cell. C, M
+// and N may be left out.
+static int parse_ranges(const char *text, struct rule *rule) {
+    rule->kind = RULE_RANGES;
+    rule->states = 2;
+    int has_birth = 0, has_survive = 0;
+    const char *p = text;
+    const char *weights = NULL;
+
+    while (p && *p) {
+        char section = (char)toupper((unsigned char)*p++);
+        char *end;
+        long value = 0;
+        if (section == 'R' || section == 'C' || section == 'M') {
+            value = strtol(p, &end, 10);
+            p = (end == p) ? NULL : end;
+        }
+        if (!p) break;
+
+        if (section == 'R' && value >= 1 && value <= MAX_RADIUS) {
+            rule->neighborhood.radius = (int)value;
+        } else if (section == 'C' && value >= 0 && value <= MAX_STATES) {
+            rule->states = (value < 2) ? 2 : (int)value;
+        } else if (section == 'M' && (value == 0 || value == 1)) {
+            rule->neighborhood.include_center = (int)value;
+        } else if (section == 'B' && !has_birth) {
+            has_birth = 1;
+            p = parse_range(p, &rule->birth_min, &rule->birth_max);
+        } else if (section == 'S' && !has_survive) {
+            has_survive = 1;
+            p = parse_range(p, &rule->survive_min, &rule->survive_max);
+        } else if (section == 'N') {
+            switch (toupper((unsigned char)*p++)) {
+                case 'M': rule->neighborhood.kind = NEIGHBORHOOD_MOORE; break;
+                case 'N': rule->neighborhood.kind = NEIGHBORHOOD_VON_NEUMANN; break;
+                case 'H': rule->neighborhood.kind = NEIGHBORHOOD_HEXAGONAL; break;
+                case 'W': rule->neighborhood.kind = NEIGHBORHOOD_WEIGHTED; weights = p; break;
+                default: p = NULL; break;
+            }
+            // The weights are read once the radius is known
+            while (p && isdigit((unsigned char)*p)) p++;
+        } else {
+            p = NULL;
+        }
+
+        if (p && *p == ',') p++;
+    }
+
+    const struct neighborhood *neighborhood = &rule->neighborhood;
+    if (p && neighborhood->kind == NEIGHBORHOOD_HEXAGONAL && neighborhood->radius != 1) p = NULL;
+    if (p && neighborhood->kind == NEIGHBORHOOD_WEIGHTED) {
+        const char *end = (neighborhood->radius <= MAX_WEIGHT_RADIUS) ? parse_weights(weights, &rule->neighborhood) : NULL;
+        if (!end || isdigit((unsigned char)*end)) p = NULL;
+    }
+    if (!p || !has_birth || !has_survive) {
+        fprintf(stderr, "Invalid rule string: %s\n", text);
+        return -1;
+    }
+    return 0;
+}
+
+// Parse a rule string into a rule: "cyclic", a B/S rule such as "B3/S23" or
+// "B36/S23", or a Generations rule such as "B2/S/C8". A B/S rule ending in V
+// counts the von Neumann neighborhood and one ending in H the hexagonal one,
+// as in "B2/S34H". Larger than Life rules start with their radius, see
+// parse_ranges. Returns 0 on success and -1 if the string is not a valid rule.
+int parse_rule(const char *text, struct rule *rule) {
+    memset(rule, 0, sizeof(*rule));
+    snprintf(rule->name, sizeof(rule->name), "%s", text);
+    rule->neighborhood.radius = 1;
+    if (strlen(text) >= sizeof(rule->name)) {
+        // Snapshots and recordings store the name to parse it back
+        fprintf(stderr, "Rule string longer than %d characters: %s\n", RULE_NAME_LENGTH - 1, text);
+        return -1;
+    }
+
+    if (toupper((unsigned char)text[0]) == 'R' && isdigit((unsigned char)text[1])) {
+        return parse_ranges(text, rule);
+    }
+
+    if (strcasecmp(text, "cyclic") == 0) {
+        rule->kind = RULE_CYCLIC;
+        return 0;
+    }
+
+    rule->kind = RULE_LIFE_LIKE;
+    rule->states = 2;
+    int has_birth = 0, has_survive = 0;
+    const char *p = text;
+
+    while (p && *p) {
+        char section = (char)toupper((unsigned char)*p++);
+        if (section == 'B' && !has_birth) {
+            has_birth = 1;
+            p = parse_counts(p, rule->birth);
+        } else if (section == 'S' && !has_survive) {
+            has_survive = 1;
+            p = parse_counts(p, rule->survive);
+        } else if (section == 'C' || section == 'G') {
+            char *end;
+            long states = strtol(p, &end, 10);
+            if (end == p || states < 2 || states > MAX_STATES) {
+                p = NULL;
+                break;
+            }
+            rule->states = (int)states;
+            p = end;
+        } else if ((section == 'V' || section == 'H') && rule->neighborhood.kind == NEIGHBORHOOD_MOORE) {
+            rule->neighborhood.kind = (section == 'V') ? NEIGHBORHOOD_VON_NEUMANN : NEIGHBORHOOD_HEXAGONAL;
+        } else {
+            p = NULL;
+            break;
+        }
+
+        if (p && *p == '/') p++;
+    }
+
+    // Neither smaller neighborhood has 8 neighbors to count
+    int neighbors = (rule->neighborhood.kind == NEIGHBORHOOD_VON_NEUMANN) ? 4
+                  : (rule->neighborhood.kind == NEIGHBORHOOD_HEXAGONAL) ? 6 : 8;
+    for (int n = neighbors + 1; p && n < NEIGHBOR_COUNTS; n++) {
+        if (rule->birth[n] || rule->survive[n]) p = NULL;
+    }
+    if (!p || !has_birth || !has_survive) {
+        fprintf(stderr, "Invalid rule string: %s\n", text);
+        return -1;
+    }
+
+    build_table(rule);
+    return 0;
+}
+
+// Farthest a cell's neighbors can be, in rows or columns
+int rule_reach(const struct rule *rule) {
+    return rule->neighborhood.radius;
+}
+
+static struct rule life, highlife, cyclic;
+static pthread_once_t builtin_rules_parsed = PTHREAD_ONCE_INIT;
+
+static void parse_builtin_rules(void) {
+    parse_rule("B3/S23", &life);
+    parse_rule("B3/S135", &highlife);   // What highlife_rule has always computed
+    parse_rule("cyclic", &cyclic);
+}
+
+// Rule matching one of the built-in rule functions, or NULL for any other
+// callback. Safe to call from any thread, the first call parses them all.
+const struct rule *builtin_rule(int (*rule_function)(int, int, const uint8_t *, struct grid *)) {
+    pthread_once(&builtin_rules_parsed, parse_builtin_rules);
+
+    if (rule_function == conways_game_of_life_rule) return &life;
+    if (rule_function == highlife_rule) return &highlife;
+    if (rule_function == cyclic_rule) return &cyclic;
+    return NULL;
+}
@@ -0,0 +1,57 @@
+#ifndef RULE_H
+#define RULE_H
+
+#include "grid.h"
+
+#define RULE_NAME_LENGTH 32
+#define NEIGHBOR_COUNTS 9   // 0 to 8 live neighbors in the Moore neighborhood
+#define MAX_RADIUS 64       // Farthest reach of a neighborhood, one tile
+#define MAX_WEIGHT_RADIUS 3 // Weighted neighborhoods give every weight, in a square this far from the cell;
+                            // a rule name only has room to spell out radius 1
+#define WEIGHT_SPAN (2 * MAX_WEIGHT_RADIUS + 1)
+
+enum rule_kind {
+    RULE_LIFE_LIKE,     // B/S rules, including multi-state Generations rules
+    RULE_CYCLIC,        // Advance to the successor state when a neighbor has it
+    RULE_RANGES         // Larger than Life: birth and survival are ranges of neighbor counts
+};
+
+// Cells counted as neighbors
+enum neighborhood_kind {
+    NEIGHBORHOOD_MOORE,         // The square of side 2 * radius + 1
+    NEIGHBORHOOD_VON_NEUMANN,   // Cells at most radius steps away along rows and columns
+    NEIGHBORHOOD_HEXAGONAL,     // Moore without the NE and SW corners, a hex grid on squares; radius 1
+    NEIGHBORHOOD_WEIGHTED       // Every cell of the square counted weights times
+};
+
+struct neighborhood {
+    int kind;               // enum neighborhood_kind
+    int radius;             // 1 to MAX_RADIUS, at most MAX_WEIGHT_RADIUS when weighted
+    int include_center;     // Count the cell itself, as Larger than Life's M1 does; weights give their own
+    int8_t weights[WEIGHT_SPAN][WEIGHT_SPAN];  // Weighted only, the cell at [MAX_WEIGHT_RADIUS][MAX_WEIGHT_RADIUS]
+};
+
+// A parsed rule. Life-like rules are fully described by their transition
+// table: the next state of a cell is table[state][live_neighbors], where
+// live neighbors are the neighbors in state 1. Their neighborhood has radius
+// 1, so the count stays below NEIGHBOR_COUNTS. Larger than Life rules compare
+// the count against birth_min to birth_max and survive_min to survive_max
+// instead; with more than 2 states a dying cell goes through the higher
+// states as in Generations rules.
+struct rule {
+    int kind;           // enum rule_kind
+    int states;         // States the rule uses, 0 to take them from the grid
+    uint8_t birth[NEIGHBOR_COUNTS];
+    uint8_t survive[NEIGHBOR_COUNTS];
+    uint8_t table[MAX_STATES][NEIGHBOR_COUNTS];
+    struct neighborhood neighborhood;
+    int birth_min, birth_max;
+    int survive_min, survive_max;
+    char name[RULE_NAME_LENGTH];
+};
+
+int parse_rule(const char *text, struct rule *rule);
+int rule_reach(const struct rule *rule);
+const struct rule *builtin_rule(int (*rule_function)(int, int, const uint8_t *, struct grid *));
+
+#endif
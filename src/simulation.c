@@ -0,0 +1,120 @@
+#include "simulation.h"
+#include "profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static void sleep_ms(int ms) {
+    struct timespec duration = {ms / 1000, (long)(ms % 1000) * 1000000L};
+    nanosleep(&duration, NULL);
+}
+
+// Copy the current generation into the back buffer and swap it into the middle
+static void publish_frame(struct simulation *simulation) {
+    memcpy(simulation->snapshots[simulation->back], current_cells(simulation->grid), simulation->snapshot_bytes);
+    simulation->snapshot_generation[simulation->back] = simulation->grid->generation;
+    simulation->back = atomic_exchange(&simulation->middle, simulation->back | SNAPSHOT_FRESH) & ~SNAPSHOT_FRESH;
+}
+
+static void *simulation_main(void *arg) {
+    struct simulation *simulation = arg;
+
+    while (atomic_load(&simulation->running)) {
+        if (atomic_load(&simulation->paused)) {
+            sleep_ms(1);
+            continue;
+        }
+        PROFILE_BEGIN(PHASE_STEP);
+        update_grid_with_rule(simulation->grid, simulation->rule);
+        PROFILE_END(PHASE_STEP);
+        publish_frame(simulation);
+
+        int delay = atomic_load(&simulation->delay_ms);
+        if (delay > 0) {
+            sleep_ms(delay);
+        }
+    }
+    return NULL;
+}
+
+// Start stepping the grid on a new thread. The grid must not be touched
+// until stop_simulation; its frames are read through latest_frame instead.
+struct simulation *start_simulation(struct grid *grid, const struct rule *rule, int delay_ms) {
+    struct simulation *simulation = calloc(1, sizeof(struct simulation));
+    if (!simulation) {
+        fprintf(stderr, "Memory allocation failed for simulation!\n");
+        exit(1);
+    }
+    simulation->grid = grid;
+    simulation->rule = rule;
+    simulation->layout = *grid;
+    simulation->snapshot_bytes = grid->stride * (grid->height + 2);
+    for (int i = 0; i < SNAPSHOT_BUFFERS; i++) {
+        simulation->snapshots[i] = mallocgrid(simulation->snapshot_bytes);
+    }
+    simulation->back = 0;
+    simulation->front = 1;
+    atomic_init(&simulation->middle, 2);
+    atomic_init(&simulation->running, 1);
+    atomic_init(&simulation->paused, 0);
+    atomic_init(&simulation->delay_ms, delay_ms);
+
+    // The starting generation is the first frame
+    publish_frame(simulation);
+
+    if (pthread_create(&simulation->thread, NULL, simulation_main, simulation) != 0) {
+        fprintf(stderr, "Could not start simulation thread!\n");
+        exit(1);
+    }
+    return simulation;
+}
+
+// Stop and join the simulation thread; the grid then holds its last generation
+void stop_simulation(struct simulation *simulation) {
+    if (!simulation) return;
+
+    atomic_store(&simulation->running, 0);
+    pthread_join(simulation->thread, NULL);
+    for (int i = 0; i < SNAPSHOT_BUFFERS; i++) {
+        free_cells(simulation->snapshots[i], simulation->snapshot_bytes);
+    }
+    free(simulation);
+}
+
+void set_simulation_paused(struct simulation *simulation, int paused) {
+    atomic_store(&simulation->paused, paused);
+}
+
+void set_simulation_delay(struct simulation *simulation, int delay_ms) {
+    atomic_store(&simulation->delay_ms, delay_ms < 0 ? 0 : delay_ms);
+}
+
+// Point view at the newest published generation, a read-only grid that stays
+// valid until the next call. Returns whether the frame is new since the
+// last call; frames published in between are skipped.
+int latest_frame(struct simulation *simulation, struct grid *view, uint64_t *generation) {
+    int fresh = 0;
+    if (atomic_load(&simulation->middle) & SNAPSHOT_FRESH) {
+        simulation->front = atomic_exchange(&simulation->middle, simulation->front) & ~SNAPSHOT_FRESH;
+        fresh = 1;
+    }
+
+    *view = simulation->layout;
+    view->grid1 = simulation->snapshots[simulation->front];
+    view->grid2 = simulation->snapshots[simulation->front];
+    view->current = 0;
+    view->pool = NULL;
+    view->activity = NULL;
+    view->hash = NULL;
+    view->stats = NULL;
+    view->windows = NULL;
+    view->window_count = 0;
+    view->temporal_tiles = NULL;
+    view->temporal_bytes = 0;
+    view->generation = simulation->snapshot_generation[simulation->front];
+    if (generation) {
+        *generation = view->generation;
+    }
+    return fresh;
+}
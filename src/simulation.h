@@ -0,0 +1,41 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "grid.h"
+#include "rule.h"
+
+#define SNAPSHOT_BUFFERS 3
+#define SNAPSHOT_FRESH 4    // Set in the middle index while it holds an unread frame
+
+// Runs a grid on its own thread and hands finished generations to the
+// display through a triple buffer. The simulation thread owns one buffer,
+// the reader owns another and the third sits in the middle; each side swaps
+// its buffer with the middle one in a single atomic exchange, so neither
+// ever waits for the other and the reader always gets the newest frame.
+struct simulation {
+    struct grid *grid;              // Owned by the simulation thread while it runs
+    const struct rule *rule;
+    struct grid layout;             // Copy of the grid's fields for building frame views
+    pthread_t thread;
+    uint8_t *snapshots[SNAPSHOT_BUFFERS];
+    uint64_t snapshot_generation[SNAPSHOT_BUFFERS];
+    size_t snapshot_bytes;
+    int back;                       // Buffer the simulation thread writes
+    int front;                      // Buffer the reader holds
+    atomic_int middle;              // Buffer in between, with SNAPSHOT_FRESH
+    atomic_int running;
+    atomic_int paused;
+    atomic_int delay_ms;            // Pause between generations, 0 runs uncapped
+};
+
+struct simulation *start_simulation(struct grid *grid, const struct rule *rule, int delay_ms);
+void stop_simulation(struct simulation *simulation);
+
+void set_simulation_paused(struct simulation *simulation, int paused);
+void set_simulation_delay(struct simulation *simulation, int delay_ms);
+
+int latest_frame(struct simulation *simulation, struct grid *view, uint64_t *generation);
+
+#endif
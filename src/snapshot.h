@@ -0,0 +1,44 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "grid.h"
+#include "rule.h"
+
+#define SNAPSHOT_MAGIC "CASNAP\r\n"
+#define SNAPSHOT_VERSION 1
+
+// Binary snapshot: this header followed by the grid's rows 0 to height - 1
+// exactly as they are laid out in memory, stride bytes each with the halo
+// columns included, so saving and loading are a single copy. Fields are in
+// the byte order of the machine that wrote them.
+struct snapshot_header {
+    char magic[8];              // SNAPSHOT_MAGIC
+    uint32_t version;           // SNAPSHOT_VERSION
+    uint32_t header_bytes;      // sizeof(struct snapshot_header), where the payload starts
+    uint32_t width;
+    uint32_t height;
+    uint32_t states;
+    uint8_t format;             // enum cell_format
+    uint8_t boundary;           // enum boundary_mode
+    uint16_t reserved;
+    uint64_t stride;
+    uint64_t generation;
+    uint64_t seed;
+    uint64_t payload_bytes;     // stride * height
+    uint64_t checksum;          // Of the payload, see snapshot_checksum
+    char rule[RULE_NAME_LENGTH];
+};
+
+// What a snapshot says about the run besides its cells
+struct snapshot_info {
+    uint64_t generation;
+    uint64_t seed;
+    char rule[RULE_NAME_LENGTH];    // Empty for text dumps and snapshots saved without a rule
+};
+
+uint64_t snapshot_checksum(const uint8_t *data, size_t size);
+
+int save_snapshot(const struct grid *grid, const struct rule *rule, uint64_t seed, const char *filename);
+int load_snapshot(struct grid *grid, struct snapshot_info *info, int states, const char *filename);
+
+#endif
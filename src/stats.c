@@ -0,0 +1,354 @@
+#include "stats.h"
+#include "activity.h"
+#include "kernel.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_COUNTERS 1
+#endif
+
+#define LOW_BITS 0x7F7F7F7F7F7F7F7FULL
+#define HIGH_BITS 0x8080808080808080ULL
+#define BYTE_ONES 0x0101010101010101ULL
+#define SIMD_STATES 16      // Byte grids with up to this many states count them with compares
+
+static void *malloc_stats(size_t size) {
+    void *data = calloc(1, size);
+    if (!data) {
+        fprintf(stderr, "Memory allocation failed for grid statistics!\n");
+        exit(1);
+    }
+    return data;
+}
+
+static inline uint64_t load_word(const uint8_t *data) {
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    return word;
+}
+
+// The high bit of every byte of word that is 0, and nothing else
+static inline uint64_t zero_bytes(uint64_t word) {
+    return ~(((word & LOW_BITS) + LOW_BITS) | word | LOW_BITS);
+}
+
+// Bits set in word. Spelled out, since without -mpopcnt the builtin is a
+// library call.
+static inline uint64_t popcount(uint64_t word) {
+    word -= (word >> 1) & 0x5555555555555555ULL;
+    word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+    word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (word * BYTE_ONES) >> 56;
+}
+
+// Bytes of a mask from zero_bytes, which has at most the high bit of each
+static inline uint64_t count_high_bits(uint64_t mask) {
+    return ((mask >> 7) * BYTE_ONES) >> 56;
+}
+
+// Count cells x0 to x1 of a bit-grid row. Bit 0 of the padded row is the
+// left halo, so cell x is bit x + 1. With changes_only the population is
+// counted as the difference to the old row. Inlined once with the popcnt
+// instruction and once without.
+static inline __attribute__((always_inline)) void count_bit_words(const uint8_t *old, const uint8_t *new, int x0,
+                                                                  int x1, struct stats_partial *partial,
+                                                                  int changes_only, int hardware) {
+#define BITS(word) (hardware ? (uint64_t)__builtin_popcountll(word) : popcount(word))
+    int first = x0 + 1, last = x1;
+    uint64_t births = 0, deaths = 0, live = 0;
+    for (int w = first >> 6; w <= last >> 6; w++) {
+        uint64_t mask = ~(uint64_t)0;
+        if (w == first >> 6) mask &= ~(uint64_t)0 << (first & 63);
+        if (w == last >> 6) mask &= ((uint64_t)2 << (last & 63)) - 1;
+        uint64_t before = load_word(old + (size_t)w * 8) & mask;
+        uint64_t after = load_word(new + (size_t)w * 8) & mask;
+        births += BITS(after & ~before);
+        deaths += BITS(before & ~after);
+        live += BITS(after) - (changes_only ? BITS(before) : 0);
+    }
+#undef BITS
+    partial->births += births;
+    partial->deaths += deaths;
+    partial->changed += births + deaths;
+    partial->population[1] += live;
+}
+
+#ifdef HAVE_X86_COUNTERS
+__attribute__((target("popcnt")))
+static void count_bit_span_popcnt(const uint8_t *old, const uint8_t *new, int x0, int x1,
+                                  struct stats_partial *partial, int changes_only) {
+    count_bit_words(old, new, x0, x1, partial, changes_only, 1);
+}
+
+#endif
+
+static void count_bit_span(const uint8_t *old, const uint8_t *new, int x0, int x1, struct stats_partial *partial,
+                           int changes_only) {
+#ifdef HAVE_X86_COUNTERS
+    // Every CPU with AVX2 has popcnt
+    if (get_kernel_isa() >= KERNEL_ISA_AVX2) {
+        count_bit_span_popcnt(old, new, x0, x1, partial, changes_only);
+        return;
+    }
+#endif
+    count_bit_words(old, new, x0, x1, partial, changes_only, 0);
+}
+
+// Add the births, deaths and changes among eight byte cells to sums
+static inline void count_byte_word(uint64_t before, uint64_t after, uint64_t sums[3]) {
+    uint64_t was_zero = zero_bytes(before), is_zero = zero_bytes(after);
+    sums[0] += count_high_bits(was_zero & ~is_zero);
+    sums[1] += count_high_bits(is_zero & ~was_zero);
+    sums[2] += count_high_bits(zero_bytes(before ^ after) ^ HIGH_BITS);
+}
+
+// Births, deaths and changes of count byte cells, eight at a time
+static void count_byte_span(const uint8_t *old, const uint8_t *new, size_t count, struct stats_partial *partial) {
+    uint64_t sums[3] = {0, 0, 0};
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        count_byte_word(load_word(old + i), load_word(new + i), sums);
+    }
+    if (i < count) {
+        // Bytes past the end load as 0 in both, which is no change
+        uint64_t before = 0, after = 0;
+        memcpy(&before, old + i, count - i);
+        memcpy(&after, new + i, count - i);
+        count_byte_word(before, after, sums);
+    }
+    partial->births += sums[0];
+    partial->deaths += sums[1];
+    partial->changed += sums[2];
+}
+
+#ifdef HAVE_X86_COUNTERS
+// Sum the byte counters of a vector into a total
+__attribute__((target("sse2")))
+static inline uint64_t sum_bytes(__m128i counters) {
+    __m128i sums = _mm_sad_epu8(counters, _mm_setzero_si128());
+    return (uint64_t)_mm_cvtsi128_si64(sums) + (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(sums, sums));
+}
+
+// Births, deaths, changes and the population of every state but 0 of count
+// byte cells, sixteen at a time. Each counter vector holds one byte per lane
+// and is added up before it can overflow. Inlined for every state count up
+// to SIMD_STATES, so the counters stay in registers.
+__attribute__((target("sse2"))) static inline __attribute__((always_inline))
+void count_byte_lanes(const uint8_t *old, const uint8_t *new, size_t count, const int states,
+                      struct stats_partial *partial) {
+    const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi8(1);
+    size_t i = 0;
+    while (i + 16 <= count) {
+        __m128i births = zero, deaths = zero, kept = zero;
+        __m128i population[SIMD_STATES];
+#pragma GCC unroll 16
+        for (int s = 1; s < states; s++) {
+            population[s] = zero;
+        }
+        size_t chunks = (count - i) / 16 > 255 ? 255 : (count - i) / 16;
+        for (size_t end = i + chunks * 16; i < end; i += 16) {
+            __m128i before = _mm_loadu_si128((const __m128i *)(old + i));
+            __m128i after = _mm_loadu_si128((const __m128i *)(new + i));
+            __m128i was_zero = _mm_cmpeq_epi8(before, zero), is_zero = _mm_cmpeq_epi8(after, zero);
+            // Compares give -1 in every matching lane
+            births = _mm_sub_epi8(births, _mm_andnot_si128(is_zero, was_zero));
+            deaths = _mm_sub_epi8(deaths, _mm_andnot_si128(was_zero, is_zero));
+            kept = _mm_sub_epi8(kept, _mm_cmpeq_epi8(before, after));
+            __m128i state = one;
+#pragma GCC unroll 16
+            for (int s = 1; s < states; s++) {
+                population[s] = _mm_sub_epi8(population[s], _mm_cmpeq_epi8(after, state));
+                state = _mm_add_epi8(state, one);
+            }
+        }
+        partial->births += sum_bytes(births);
+        partial->deaths += sum_bytes(deaths);
+        partial->changed += chunks * 16 - sum_bytes(kept);
+        for (int s = 1; s < states; s++) {
+            partial->population[s] += sum_bytes(population[s]);
+        }
+    }
+    count_byte_span(old + i, new + i, count - i, partial);
+    for (; i < count; i++) {
+        partial->population[new[i]]++;
+    }
+}
+
+#define COUNT_BYTE_LANES(n) case n: count_byte_lanes(old, new, count, n, partial); break
+
+// The above for grids of at most SIMD_STATES states
+__attribute__((target("sse2")))
+static void count_byte_span_sse2(const uint8_t *old, const uint8_t *new, size_t count, int states,
+                                 struct stats_partial *partial) {
+    switch (states) {
+        COUNT_BYTE_LANES(3); COUNT_BYTE_LANES(4); COUNT_BYTE_LANES(5); COUNT_BYTE_LANES(6);
+        COUNT_BYTE_LANES(7); COUNT_BYTE_LANES(8); COUNT_BYTE_LANES(9); COUNT_BYTE_LANES(10);
+        COUNT_BYTE_LANES(11); COUNT_BYTE_LANES(12); COUNT_BYTE_LANES(13); COUNT_BYTE_LANES(14);
+        COUNT_BYTE_LANES(15); COUNT_BYTE_LANES(16);
+    }
+}
+#endif
+
+// Add the states of count byte cells to four histograms in turn, so that
+// runs of one state do not wait on their own increments
+static void histogram_bytes(const uint8_t *cells, size_t count, uint64_t counts[4][MAX_STATES]) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        counts[0][cells[i]]++;
+        counts[1][cells[i + 1]]++;
+        counts[2][cells[i + 2]]++;
+        counts[3][cells[i + 3]]++;
+    }
+    for (; i < count; i++) {
+        counts[0][cells[i]]++;
+    }
+}
+
+// Clear the partials of threads threads, making room for them if needed
+void begin_grid_stats(struct grid *grid, int threads) {
+    struct grid_stats *stats = grid->stats;
+    if (stats->partial_count < threads) {
+        free(stats->partials);
+        stats->partials = aligned_alloc(_Alignof(struct stats_partial), (size_t)threads * sizeof(struct stats_partial));
+        if (!stats->partials) {
+            fprintf(stderr, "Memory allocation failed for grid statistics!\n");
+            exit(1);
+        }
+        stats->partial_count = threads;
+    }
+    memset(stats->partials, 0, (size_t)threads * sizeof(struct stats_partial));
+}
+
+// Count rows y0 to y1 of the generation in next, stepped from cells, into
+// the partial of a thread
+void count_stats_rows(struct grid *grid, const uint8_t *cells, const uint8_t *next, int y0, int y1, int thread) {
+    struct stats_partial *partial = &grid->stats->partials[thread];
+    if (grid->format == CELL_FORMAT_BITS) {
+        for (int y = y0; y < y1; y++) {
+            count_bit_span(grid_row(grid, cells, y), grid_row(grid, next, y), 0, grid->width, partial, 0);
+        }
+        return;
+    }
+
+#ifdef HAVE_X86_COUNTERS
+    if (grid->states <= SIMD_STATES && get_kernel_isa() >= KERNEL_ISA_SSE2) {
+        for (int y = y0; y < y1; y++) {
+            count_byte_span_sse2(grid_row(grid, cells, y) + 1, grid_row(grid, next, y) + 1, (size_t)grid->width,
+                                 grid->states, partial);
+        }
+        return;
+    }
+#endif
+
+    uint64_t counts[4][MAX_STATES];
+    for (int h = 0; h < 4; h++) {
+        memset(counts[h], 0, (size_t)grid->states * sizeof(uint64_t));
+    }
+    for (int y = y0; y < y1; y++) {
+        const uint8_t *old = grid_row(grid, cells, y) + 1, *new = grid_row(grid, next, y) + 1;
+        count_byte_span(old, new, (size_t)grid->width, partial);
+        histogram_bytes(new, (size_t)grid->width, counts);
+    }
+    for (int s = 0; s < grid->states; s++) {
+        partial->population[s] += counts[0][s] + counts[1][s] + counts[2][s] + counts[3][s];
+    }
+}
+
+// Count the tiles that changed in the last generation into the first
+// partial, the population as its change. Every other cell is as it was.
+void count_changed_tiles(struct grid *grid, const uint8_t *cells, const uint8_t *next) {
+    int count;
+    const int *tiles = changed_tiles(grid, &count);
+    struct stats_partial *partial = &grid->stats->partials[0];
+    for (int i = 0; i < count; i++) {
+        int x0, x1, y0, y1;
+        tile_bounds(grid, tiles[i], &x0, &x1, &y0, &y1);
+        for (int y = y0; y < y1; y++) {
+            const uint8_t *old = grid_row(grid, cells, y), *new = grid_row(grid, next, y);
+            if (grid->format == CELL_FORMAT_BITS) {
+                count_bit_span(old, new, x0, x1, partial, 1);
+                continue;
+            }
+            count_byte_span(old + 1 + x0, new + 1 + x0, (size_t)(x1 - x0), partial);
+            for (int x = x0 + 1; x <= x1; x++) {
+                partial->population[new[x]]++;
+                partial->population[old[x]]--;
+            }
+        }
+    }
+}
+
+// Add up the partials of threads threads into the statistics of the new
+// current generation. With changes_only they hold population changes.
+void finish_grid_stats(struct grid *grid, int threads, int changes_only) {
+    struct grid_stats *stats = grid->stats;
+    stats->births = stats->deaths = stats->changed = 0;
+    if (!changes_only) {
+        memset(stats->population, 0, sizeof(stats->population));
+    }
+    for (int t = 0; t < threads; t++) {
+        const struct stats_partial *partial = &stats->partials[t];
+        stats->births += partial->births;
+        stats->deaths += partial->deaths;
+        stats->changed += partial->changed;
+        for (int s = 1; s < grid->states; s++) {
+            stats->population[s] += partial->population[s];
+        }
+    }
+    // Bit grids only count live cells, so state 0 is whatever is left over
+    uint64_t live = 0;
+    for (int s = 1; s < grid->states; s++) {
+        live += stats->population[s];
+    }
+    stats->population[0] = (uint64_t)grid->width * (uint64_t)grid->height - live;
+    stats->generation = grid->generation;
+}
+
+// Count the current generation from scratch, with no births, deaths or changes
+void recount_grid_stats(struct grid *grid) {
+    if (!grid->stats) return;
+    const uint8_t *cells = current_cells(grid);
+    begin_grid_stats(grid, 1);
+    count_stats_rows(grid, cells, cells, 0, grid->height, 0);
+    finish_grid_stats(grid, 1, 0);
+}
+
+void enable_grid_stats(struct grid *grid) {
+    if (grid->stats) return;
+    grid->stats = malloc_stats(sizeof(struct grid_stats));
+    recount_grid_stats(grid);
+}
+
+void disable_grid_stats(struct grid *grid) {
+    if (!grid->stats) return;
+    free(grid->stats->partials);
+    free(grid->stats);
+    grid->stats = NULL;
+}
+
+// Cells not in state 0
+uint64_t live_cells(const struct grid *grid) {
+    return grid->stats ? (uint64_t)grid->width * (uint64_t)grid->height - grid->stats->population[0] : 0;
+}
+
+// Start a metrics log: one CSV line per generation, with the population of
+// every state but 0 for grids of more than two states
+int write_metrics_header(FILE *file, const struct grid *grid) {
+    fprintf(file, "generation,live,births,deaths,changed");
+    for (int s = 1; grid->states > 2 && s < grid->states; s++) {
+        fprintf(file, ",state%d", s);
+    }
+    return (fprintf(file, "\n") < 0) ? -1 : 0;
+}
+
+int write_metrics(FILE *file, const struct grid *grid) {
+    const struct grid_stats *stats = grid->stats;
+    fprintf(file, "%llu,%llu,%llu,%llu,%llu", (unsigned long long)stats->generation,
+            (unsigned long long)live_cells(grid), (unsigned long long)stats->births,
+            (unsigned long long)stats->deaths, (unsigned long long)stats->changed);
+    for (int s = 1; grid->states > 2 && s < grid->states; s++) {
+        fprintf(file, ",%llu", (unsigned long long)stats->population[s]);
+    }
+    return (fprintf(file, "\n") < 0) ? -1 : 0;
+}
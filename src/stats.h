@@ -0,0 +1,48 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include "grid.h"
+
+// Per-generation statistics of a grid, kept up to date by
+// update_grid_with_rule. Each thread counts the cells of its band into a
+// partial of its own; the partials are added up once the generation is done.
+// Most kernels count while stepping, as changes against the generation
+// before (see select_counting_kernel); otherwise the rows are counted right
+// after stepping them, while the old and new rows are still in cache. With
+// activity tracking only the tiles that changed are counted, also against
+// the generation before. Changing cells by other means calls for
+// recount_grid_stats, which leaves births, deaths and changes at 0.
+
+// One thread's counts for a generation, on cache lines of its own
+struct stats_partial {
+    _Alignas(64) uint64_t births;
+    uint64_t deaths;
+    uint64_t changed;
+    uint64_t population[MAX_STATES];
+};
+
+struct grid_stats {
+    uint64_t population[MAX_STATES];    // Cells in each state in the current generation
+    uint64_t births;                    // Cells that left state 0 in the last generation
+    uint64_t deaths;                    // Cells that went back to state 0
+    uint64_t changed;                   // Cells whose state changed
+    uint64_t generation;                // The counts are of this generation
+    struct stats_partial *partials;
+    int partial_count;
+};
+
+void enable_grid_stats(struct grid *grid);
+void disable_grid_stats(struct grid *grid);
+void recount_grid_stats(struct grid *grid);
+uint64_t live_cells(const struct grid *grid);
+
+void begin_grid_stats(struct grid *grid, int threads);
+void count_stats_rows(struct grid *grid, const uint8_t *cells, const uint8_t *next, int y0, int y1, int thread);
+void count_changed_tiles(struct grid *grid, const uint8_t *cells, const uint8_t *next);
+void finish_grid_stats(struct grid *grid, int threads, int changes_only);
+
+int write_metrics_header(FILE *file, const struct grid *grid);
+int write_metrics(FILE *file, const struct grid *grid);
+
+#endif
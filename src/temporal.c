@@ -0,0 +1,189 @@
+#include "grid.h"
+#include "kernel.h"
+#include "pool.h"
+#include "activity.h"
+#include "cycle.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Temporal blocking: instead of streaming the whole grid through memory once
+// per generation, the grid is cut into full-width bands of rows that are
+// copied into a cache-sized scratch tile and stepped several generations in a
+// row. The tile carries `depth` extra ghost rows on each side whose values
+// go stale one row per generation (a trapezoid), so after `depth` steps the
+// band itself is still exact and is copied to the next buffer. Tiles that
+// reach a dead or reflective edge rebuild the halo row there every step
+// instead.
+
+#define TEMPORAL_DEPTH 8                        // Generations per pass over the grid
+#define TEMPORAL_TILE_BYTES (256 * 1024)        // Both tile buffers, when the L2 size is unknown
+#define TEMPORAL_CACHE_BYTES ((size_t)16 << 20) // Smaller byte grids step faster one generation at a time
+#define TEMPORAL_MIN_BAND_ROWS (4 * TEMPORAL_DEPTH) // Shorter bands spend more on ghost rows than they save
+
+struct temporal_job {
+    struct grid *grid;
+    const struct rule *rule;
+    step_kernel kernel;
+    int depth;
+    int band_rows;
+    int bands;
+    uint8_t *scratch;       // Two tile buffers per thread
+    size_t tile_bytes;      // Of one tile buffer
+};
+
+// Step one band of rows [y0, y1) depth generations and store it in the next buffer
+static void step_band_in_tile(struct temporal_job *job, uint8_t *tile_cells[2], int y0, int y1) {
+    struct grid *grid = job->grid;
+    int depth = job->depth;
+    int torus = (grid->boundary == BOUNDARY_TORUS);
+
+    // Ghost rows stop at a dead or reflective edge, which the tile then
+    // reaches and has to treat as its own boundary
+    int ghost_top = torus ? depth : (y0 < depth ? y0 : depth);
+    int ghost_bottom = torus ? depth : (grid->height - y1 < depth ? grid->height - y1 : depth);
+    int top_edge = !torus && y0 - ghost_top == 0;
+    int bottom_edge = !torus && y1 + ghost_bottom == grid->height;
+
+    // The tile is a grid of its own with the same row layout, so the
+    // regular kernels and halo helpers work on it unchanged
+    struct grid tile = *grid;
+    tile.height = (y1 - y0) + ghost_top + ghost_bottom;
+    tile.pool = NULL;
+
+    const uint8_t *source = current_cells(grid);
+    for (int r = 0; r < tile.height; r++) {
+        int y = y0 - ghost_top + r;
+        if (torus) {
+            y = ((y % grid->height) + grid->height) % grid->height;
+        }
+        memcpy(grid_row(&tile, tile_cells[0], r), grid_row(grid, source, y), grid->stride);
+    }
+
+    int dead = dead_halo_value(grid);
+    for (int step = 0; step < depth; step++) {
+        uint8_t *cells = tile_cells[step & 1];
+        uint8_t *next = tile_cells[(step + 1) & 1];
+        int lo = top_edge ? 0 : step + 1;
+        int hi = tile.height - (bottom_edge ? 0 : step + 1);
+
+        refresh_halo_columns(&tile, cells, lo - 1 < 0 ? 0 : lo - 1, hi + 1 > tile.height ? tile.height : hi + 1);
+        if (top_edge) {
+            if (grid->boundary == BOUNDARY_REFLECT) {
+                memcpy(grid_row(&tile, cells, -1), grid_row(&tile, cells, 0), grid->stride);
+            } else {
+                memset(grid_row(&tile, cells, -1), dead, grid->stride);
+            }
+        }
+        if (bottom_edge) {
+            if (grid->boundary == BOUNDARY_REFLECT) {
+                memcpy(grid_row(&tile, cells, tile.height), grid_row(&tile, cells, tile.height - 1), grid->stride);
+            } else {
+                memset(grid_row(&tile, cells, tile.height), dead, grid->stride);
+            }
+        }
+
+        job->kernel(&tile, job->rule, cells, next, 0, tile.width, lo, hi);
+    }
+
+    uint8_t *result = tile_cells[depth & 1];
+    uint8_t *target = next_cells(grid);
+    for (int y = y0; y < y1; y++) {
+        memcpy(grid_row(grid, target, y), grid_row(&tile, result, y - y0 + ghost_top), grid->stride);
+    }
+}
+
+static void step_bands(void *arg, int thread, int threads) {
+    struct temporal_job *job = arg;
+    for (int band = thread; band < job->bands; band += threads) {
+        int y0 = band * job->band_rows;
+        int y1 = (y0 + job->band_rows < job->grid->height) ? y0 + job->band_rows : job->grid->height;
+        uint8_t *tile_cells[2] = {job->scratch + 2 * thread * job->tile_bytes,
+                                  job->scratch + (2 * thread + 1) * job->tile_bytes};
+        step_band_in_tile(job, tile_cells, y0, y1);
+    }
+}
+
+// Bytes of a cache level from the system, or fallback if it does not say
+static size_t cache_bytes(int name, size_t fallback) {
+    long bytes = sysconf(name);
+    return (bytes > 0) ? (size_t)bytes : fallback;
+}
+
+// Rows of a band that fit in half of L2 once the ghost rows are added
+static int band_rows(const struct grid *grid) {
+    size_t tile_budget = cache_bytes(_SC_LEVEL2_CACHE_SIZE, 2 * TEMPORAL_TILE_BYTES) / 2;
+    return (int)(tile_budget / (2 * grid->stride)) - 2 * TEMPORAL_DEPTH - 2;
+}
+
+// Advance the grid a number of generations, TEMPORAL_DEPTH at a time, with
+// each band of rows loaded from memory once per pass, whatever the grid's
+// size. The result is the same as calling update_grid_with_rule that many
+// times.
+void update_grid_blocked(struct grid *grid, const struct rule *rule, int generations) {
+    // The ghost rows only cover neighbors one row away
+    if (rule_reach(rule) > 1) {
+        for (int i = 0; i < generations; i++) {
+            update_grid_with_rule(grid, rule);
+        }
+        return;
+    }
+
+    int threads = grid->pool ? grid->pool->threads : 1;
+    struct temporal_job job;
+    job.grid = grid;
+    job.rule = rule;
+    job.kernel = select_kernel(grid, rule);
+    int rows = band_rows(grid);
+    job.band_rows = (rows < TEMPORAL_DEPTH) ? TEMPORAL_DEPTH : rows;
+    if (job.band_rows > grid->height) {
+        job.band_rows = grid->height;
+    }
+    job.bands = (grid->height + job.band_rows - 1) / job.band_rows;
+
+    // The tiles stay with the grid for its next call
+    job.tile_bytes = grid->stride * (job.band_rows + 2 * TEMPORAL_DEPTH + 2);
+    job.tile_bytes = (job.tile_bytes + GRID_ALIGNMENT - 1) & ~(size_t)(GRID_ALIGNMENT - 1);
+    size_t scratch_bytes = 2 * (size_t)threads * job.tile_bytes;
+    if (grid->temporal_bytes != scratch_bytes) {
+        free_cells(grid->temporal_tiles, grid->temporal_bytes);
+        grid->temporal_tiles = mallocgrid(scratch_bytes);
+        grid->temporal_bytes = scratch_bytes;
+    }
+    job.scratch = grid->temporal_tiles;
+
+    while (generations > 0) {
+        job.depth = (generations < TEMPORAL_DEPTH) ? generations : TEMPORAL_DEPTH;
+        if (threads > 1) {
+            run_on_pool(grid->pool, step_bands, &job);
+        } else {
+            step_bands(&job, 0, 1);
+        }
+        grid->current = 1 - grid->current;
+        grid->generation += job.depth;
+        generations -= job.depth;
+    }
+    // The other buffer now lags several generations behind
+    mark_all_changed(grid);
+    rehash_grid(grid);
+    recount_grid_stats(grid);   // Births and deaths only cover single generations
+}
+
+// Advance the grid a number of generations, blocked only where that pays:
+// on byte grids whose two buffers no longer stay in cache, with bands tall
+// enough to make up for their ghost rows. The bit kernels do enough work
+// per word loaded that reading the grid once per generation costs them
+// nothing blocking would save. Otherwise it steps one generation at a time.
+void update_grid_generations(struct grid *grid, const struct rule *rule, int generations) {
+    size_t buffers = 2 * grid->stride * (size_t)(grid->height + 2);
+    if (grid->format == CELL_FORMAT_BYTES && buffers > TEMPORAL_CACHE_BYTES
+        && band_rows(grid) >= TEMPORAL_MIN_BAND_ROWS) {
+        update_grid_blocked(grid, rule, generations);
+        return;
+    }
+    for (int i = 0; i < generations; i++) {
+        update_grid_with_rule(grid, rule);
+    }
+}
@@ -0,0 +1,448 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "grid.h"
+#include "kernel.h"
+#include "rule.h"
+#include "pool.h"
+#include "activity.h"
+#include "hashlife.h"
+#include "world.h"
+#include "ensemble.h"
+#include "stats.h"
+#include "neighborhood.h"
+
+// Differential checks of the fast paths against the plainest way of getting
+// the same grid, on small grids so the whole run takes seconds and needs no
+// window. Each check prints a line per failure and returns the number of
+// failures; the exit status is their total. The bench times the same paths
+// on large grids.
+
+int generations = 20;
+unsigned int seed = 7;
+int boundaries[] = {BOUNDARY_DEAD, BOUNDARY_TORUS, BOUNDARY_REFLECT};
+const char *boundary_names[] = {"dead", "torus", "reflect"};
+int sizes[][2] = {{1, 1}, {3, 5}, {63, 17}, {64, 64}, {65, 33}, {130, 71}, {200, 200}};
+
+struct test_rule {
+    const char *name;
+    int (*rule_function)(int, int, const uint8_t *, struct grid *);
+    int states;
+};
+
+struct test_rule rules[] = {
+    {"life", conways_game_of_life_rule, 2},
+    {"highlife", highlife_rule, 2},
+    {"cyclic", cyclic_rule, 8},
+    {"cyclic-2", cyclic_rule, 2},   // On a bit grid, whose dead halo reads as state 0
+};
+
+#define RULE_COUNT ((int)(sizeof(rules) / sizeof(rules[0])))
+#define SIZE_COUNT ((int)(sizeof(sizes) / sizeof(sizes[0])))
+#define BOUNDARY_COUNT ((int)(sizeof(boundaries) / sizeof(boundaries[0])))
+
+// Check that two grids hold the same current generation
+static int grids_equal(const struct grid *a, const struct grid *b) {
+    for (int y = 0; y < a->height; y++) {
+        for (int x = 0; x < a->width; x++) {
+            if (get_cell(a, current_cells(a), x, y) != get_cell(b, current_cells(b), x, y)) return 0;
+        }
+    }
+    return 1;
+}
+
+static void start_grid(struct grid *grid, const struct test_rule *rule, int width, int height, int boundary) {
+    initialize_grid(grid, width, height, rule->states, NULL, seed);
+    grid->boundary = boundary;
+}
+
+// Report a failed comparison, returning 1 so it can be added up
+static int mismatch(const char *check, const struct test_rule *rule, const struct grid *grid) {
+    printf("FAIL %-12s %-10s %dx%d %s\n", check, rule->name, grid->width, grid->height,
+           boundary_names[grid->boundary]);
+    return 1;
+}
+
+// Clear everything but a square patch in the middle of the grid
+static void keep_center_patch(struct grid *grid, int patch) {
+    int x0 = (grid->width - patch) / 2, y0 = (grid->height - patch) / 2;
+    for (int y = 0; y < grid->height; y++) {
+        for (int x = 0; x < grid->width; x++) {
+            if (x < x0 || x >= x0 + patch || y < y0 || y >= y0 + patch) {
+                set_cell(grid, current_cells(grid), x, y, 0);
+            }
+        }
+    }
+}
+
+// The specialized kernels, on every instruction set the CPU has, against
+// the per-cell rule callback
+static int kernels(void) {
+    int failed = 0;
+    for (int r = 0; r < RULE_COUNT; r++) {
+        for (int s = 0; s < SIZE_COUNT; s++) {
+            for (int b = 0; b < BOUNDARY_COUNT; b++) {
+                struct grid reference;
+                start_grid(&reference, &rules[r], sizes[s][0], sizes[s][1], boundaries[b]);
+                for (int i = 0; i < generations; i++) {
+                    update_grid_per_cell(&reference, rules[r].rule_function);
+                }
+
+                int last_isa = (reference.format == CELL_FORMAT_BYTES) ? detect_kernel_isa() : KERNEL_ISA_SCALAR;
+                for (int isa = KERNEL_ISA_SCALAR; isa <= last_isa; isa++) {
+                    struct grid kernel;
+                    set_kernel_isa(isa);
+                    start_grid(&kernel, &rules[r], sizes[s][0], sizes[s][1], boundaries[b]);
+                    for (int i = 0; i < generations; i++) {
+                        update_grid(&kernel, rules[r].rule_function);
+                    }
+                    if (!grids_equal(&reference, &kernel)) {
+                        failed += mismatch(kernel_isa_name(isa), &rules[r], &kernel);
+                    }
+                    free_grid(&kernel);
+                }
+                set_kernel_isa(-1);
+                free_grid(&reference);
+            }
+        }
+    }
+    return failed;
+}
+
+// Row bands stepped on a pool against one thread
+static int threads(struct thread_pool *pool) {
+    int failed = 0;
+    for (int r = 0; r < RULE_COUNT; r++) {
+        for (int s = 0; s < SIZE_COUNT; s++) {
+            struct grid serial, parallel;
+            start_grid(&serial, &rules[r], sizes[s][0], sizes[s][1], BOUNDARY_TORUS);
+            start_grid(&parallel, &rules[r], sizes[s][0], sizes[s][1], BOUNDARY_TORUS);
+            parallel.pool = pool;
+            for (int i = 0; i < generations; i++) {
+                update_grid(&serial, rules[r].rule_function);
+                update_grid(&parallel, rules[r].rule_function);
+            }
+            if (!grids_equal(&serial, &parallel)) {
+                failed += mismatch("threads", &rules[r], &parallel);
+            }
+            parallel.pool = NULL;
+            free_grid(&serial);
+            free_grid(&parallel);
+        }
+    }
+    return failed;
+}
+
+// Temporal blocking against one update per generation, over a count of
+// generations that is not a multiple of the blocking depth
+static int temporal(struct thread_pool *pool) {
+    int failed = 0;
+    for (int r = 0; r < RULE_COUNT; r++) {
+        const struct rule *parsed = builtin_rule(rules[r].rule_function);
+        for (int s = 0; s < SIZE_COUNT; s++) {
+            for (int b = 0; b < BOUNDARY_COUNT; b++) {
+                struct grid plain, blocked;
+                start_grid(&plain, &rules[r], sizes[s][0], sizes[s][1], boundaries[b]);
+                start_grid(&blocked, &rules[r], sizes[s][0], sizes[s][1], boundaries[b]);
+                blocked.pool = pool;
+                for (int i = 0; i < generations + 3; i++) {
+                    update_grid_with_rule(&plain, parsed);
+                }
+                update_grid_blocked(&blocked, parsed, generations);
+                update_grid_blocked(&blocked, parsed, 3);
+                if (!grids_equal(&plain, &blocked) || plain.generation != blocked.generation) {
+                    failed += mismatch("temporal", &rules[r], &blocked);
+                }
+                blocked.pool = NULL;
+                free_grid(&plain);
+                free_grid(&blocked);
+            }
+        }
+    }
+    return failed;
+}
+
+// Statistics counted along the way against counting the cells afterwards,
+// stepping densely, on a pool and with activity tracking, with the counting
+// kernels of every instruction set
+static int statistics(struct thread_pool *pool) {
+    int failed = 0;
+    for (int r = 0; r < RULE_COUNT; r++) {
+        for (int s = 0; s < SIZE_COUNT; s++) {
+            for (int c = 0; c < 3 * BOUNDARY_COUNT * (detect_kernel_isa() + 1); c++) {
+                int mode = c % 3, b = c / 3 % BOUNDARY_COUNT, isa = c / 3 / BOUNDARY_COUNT;
+                struct grid grid;
+                set_kernel_isa(isa);
+                start_grid(&grid, &rules[r], sizes[s][0], sizes[s][1], boundaries[b]);
+                if (mode == 1) grid.pool = pool;
+                if (mode == 2) enable_activity_tracking(&grid);
+                enable_grid_stats(&grid);
+
+                uint8_t *before = malloc((size_t)grid.width * grid.height);
+                if (!before) {
+                    fprintf(stderr, "Memory allocation failed for test!\n");
+                    exit(1);
+                }
+                int wrong = 0;
+                for (int i = 0; i < generations && !wrong; i++) {
+                    for (int y = 0; y < grid.height; y++) {
+                        for (int x = 0; x < grid.width; x++) {
+                            before[(size_t)y * grid.width + x] = (uint8_t)get_cell(&grid, current_cells(&grid), x, y);
+                        }
+                    }
+                    update_grid(&grid, rules[r].rule_function);
+
+                    uint64_t population[MAX_STATES] = {0}, births = 0, deaths = 0, changed = 0;
+                    for (int y = 0; y < grid.height; y++) {
+                        for (int x = 0; x < grid.width; x++) {
+                            int was = before[(size_t)y * grid.width + x];
+                            int now = get_cell(&grid, current_cells(&grid), x, y);
+                            population[now]++;
+                            births += (was == 0 && now != 0);
+                            deaths += (was != 0 && now == 0);
+                            changed += (was != now);
+                        }
+                    }
+                    wrong = births != grid.stats->births || deaths != grid.stats->deaths
+                         || changed != grid.stats->changed
+                         || memcmp(population, grid.stats->population, grid.states * sizeof(uint64_t)) != 0;
+                }
+                if (wrong) {
+                    const char *modes[] = {"stats", "stats-pool", "stats-tiles"};
+                    char check[32];
+                    snprintf(check, sizeof(check), "%s/%s", modes[mode], kernel_isa_name(isa));
+                    failed += mismatch(check, &rules[r], &grid);
+                }
+                free(before);
+                grid.pool = NULL;
+                free_grid(&grid);
+            }
+            set_kernel_isa(-1);
+        }
+    }
+    return failed;
+}
+
+// Stepping only the changed tiles against stepping every cell
+static int activity(void) {
+    int failed = 0;
+    for (int r = 0; r < RULE_COUNT; r++) {
+        for (int s = 0; s < SIZE_COUNT; s++) {
+            for (int b = 0; b < BOUNDARY_COUNT; b++) {
+                struct grid plain, tracked;
+                start_grid(&plain, &rules[r], sizes[s][0], sizes[s][1], boundaries[b]);
+                start_grid(&tracked, &rules[r], sizes[s][0], sizes[s][1], boundaries[b]);
+                keep_center_patch(&plain, sizes[s][0] / 4);
+                keep_center_patch(&tracked, sizes[s][0] / 4);
+                enable_activity_tracking(&tracked);
+                for (int i = 0; i < generations; i++) {
+                    update_grid(&plain, rules[r].rule_function);
+                    update_grid(&tracked, rules[r].rule_function);
+                }
+                if (!grids_equal(&plain, &tracked)) {
+                    failed += mismatch("activity", &rules[r], &tracked);
+                }
+                free_grid(&plain);
+                free_grid(&tracked);
+            }
+        }
+    }
+    return failed;
+}
+
+// HashLife and the chunked world, which have no edges, against a dense grid
+// whose patch stays clear of its dead edges for the generations stepped
+static int unbounded(void) {
+    int failed = 0;
+    int size = 160, patch = 40;
+    for (int r = 0; r < RULE_COUNT; r++) {
+        const struct rule *parsed = builtin_rule(rules[r].rule_function);
+        struct grid plain, exported;
+        start_grid(&plain, &rules[r], size, size, BOUNDARY_DEAD);
+        keep_center_patch(&plain, patch);
+        allocate_grid(&exported, size, size, rules[r].states, NULL);
+
+        int life_like = rules[r].states == 2 && parsed->kind == RULE_LIFE_LIKE;  // All HashLife steps
+        if (life_like) {
+            struct hashlife *hashlife = create_hashlife(parsed);
+            if (hashlife) {
+                hashlife_import(hashlife, &plain);
+                hashlife_advance(hashlife, generations);
+                hashlife_export(hashlife, &exported);
+                destroy_hashlife(hashlife);
+            }
+        }
+        struct world *world = create_world(parsed, rules[r].states);
+        if (world) {
+            world_import(world, &plain, 0, 0);
+        }
+        for (int i = 0; i < generations; i++) {
+            update_grid(&plain, rules[r].rule_function);
+        }
+
+        if (life_like && !grids_equal(&plain, &exported)) {
+            failed += mismatch("hashlife", &rules[r], &plain);
+        }
+        if (world) {
+            advance_world(world, generations);
+            world_export(world, &exported, 0, 0);
+            if (!grids_equal(&plain, &exported)) {
+                failed += mismatch("world", &rules[r], &plain);
+            }
+            destroy_world(world);
+        }
+        free_grid(&plain);
+        free_grid(&exported);
+    }
+    return failed;
+}
+
+// Members of an ensemble stepped together against the same grids one by one
+static int ensemble(struct thread_pool *pool) {
+    int failed = 0;
+    for (int r = 0; r < RULE_COUNT; r++) {
+        const struct rule *parsed = builtin_rule(rules[r].rule_function);
+        struct ensemble_member members[SIZE_COUNT * BOUNDARY_COUNT];
+        int count = 0;
+        for (int s = 0; s < SIZE_COUNT; s++) {
+            for (int b = 0; b < BOUNDARY_COUNT; b++) {
+                members[count] = (struct ensemble_member){sizes[s][0], sizes[s][1], rules[r].states, boundaries[b],
+                                                          parsed, seed + count};
+                count++;
+            }
+        }
+        struct ensemble *batch = create_ensemble(members, count, pool);
+        step_ensemble(batch, generations);
+
+        for (int i = 0; i < count; i++) {
+            struct grid grid;
+            initialize_grid(&grid, members[i].width, members[i].height, rules[r].states, NULL, members[i].seed);
+            grid.boundary = members[i].boundary;
+            for (int g = 0; g < generations; g++) {
+                update_grid_with_rule(&grid, parsed);
+            }
+            if (!grids_equal(&grid, &batch->grids[i])) {
+                failed += mismatch("ensemble", &rules[r], &grid);
+            }
+            free_grid(&grid);
+        }
+        destroy_ensemble(batch);
+    }
+    return failed;
+}
+
+// The rule being stepped cell by cell through count_neighborhood
+static struct rule counted_rule;
+
+static int counted_neighborhood_rule(int x, int y, const uint8_t *cells, struct grid *grid) {
+    const struct rule *rule = &counted_rule;
+    int state = get_cell(grid, cells, x, y);
+    int count = count_neighborhood(x, y, cells, grid, &rule->neighborhood);
+    if (rule->kind == RULE_LIFE_LIKE) {
+        return rule->table[state][count];
+    }
+    if (state == 1) {
+        int kept = count >= rule->survive_min && count <= rule->survive_max;
+        return kept ? 1 : (rule->states > 2 ? 2 : 0);
+    }
+    if (state > 1) {
+        return (state + 1) % rule->states;
+    }
+    return count >= rule->birth_min && count <= rule->birth_max;
+}
+
+// Larger than Life and the other neighborhoods through their kernel against
+// counting each cell's neighborhood, alone, on a pool and with activity
+// tracking
+static int neighborhoods(struct thread_pool *pool) {
+    const char *texts[] = {
+        "R1,C0,M0,S2..3,B3..3,NM",
+        "R2,C0,M1,S4..7,B4..5,NM",
+        "R5,C0,M1,S34..58,B34..45,NM",
+        "R3,C4,M1,S10..20,B12..16,NM",
+        "R4,C0,M1,S10..20,B10..14,NN",
+        "R1,S2..3,B3..3,NW111101111",
+        "B2/S34H",
+        "B1/S012V",
+    };
+    int failed = 0;
+    for (size_t t = 0; t < sizeof(texts) / sizeof(texts[0]); t++) {
+        if (parse_rule(texts[t], &counted_rule) != 0) {
+            printf("FAIL cannot parse %s\n", texts[t]);
+            failed++;
+            continue;
+        }
+        struct test_rule rule = {texts[t], counted_neighborhood_rule, counted_rule.states};
+        for (int s = 0; s < SIZE_COUNT; s++) {
+            for (int b = 0; b < BOUNDARY_COUNT; b++) {
+                struct grid reference;
+                start_grid(&reference, &rule, sizes[s][0], sizes[s][1], boundaries[b]);
+                for (int i = 0; i < generations / 4; i++) {
+                    update_grid_per_cell(&reference, counted_neighborhood_rule);
+                }
+                for (int mode = 0; mode < 3; mode++) {
+                    struct grid kernel;
+                    start_grid(&kernel, &rule, sizes[s][0], sizes[s][1], boundaries[b]);
+                    if (mode == 1) kernel.pool = pool;
+                    if (mode == 2) enable_activity_tracking(&kernel);
+                    for (int i = 0; i < generations / 4; i++) {
+                        update_grid_with_rule(&kernel, &counted_rule);
+                    }
+                    if (!grids_equal(&reference, &kernel)) {
+                        failed += mismatch(mode == 0 ? "neighbors" : mode == 1 ? "nb-pool" : "nb-tiles",
+                                           &rule, &kernel);
+                    }
+                    kernel.pool = NULL;
+                    free_grid(&kernel);
+                }
+                free_grid(&reference);
+            }
+        }
+    }
+    return failed;
+}
+
+// Random fills on a pool against one thread
+static int random_fill(struct thread_pool *pool) {
+    int failed = 0;
+    for (int r = 0; r < RULE_COUNT; r++) {
+        for (int s = 0; s < SIZE_COUNT; s++) {
+            struct grid serial, parallel;
+            allocate_grid(&serial, sizes[s][0], sizes[s][1], rules[r].states, NULL);
+            allocate_grid(&parallel, sizes[s][0], sizes[s][1], rules[r].states, NULL);
+            parallel.pool = pool;
+            initialize_random_grid(&serial, serial.grid1, seed);
+            initialize_random_grid(&parallel, parallel.grid1, seed);
+            if (!grids_equal(&serial, &parallel)) {
+                failed += mismatch("random", &rules[r], &parallel);
+            }
+            parallel.pool = NULL;
+            free_grid(&serial);
+            free_grid(&parallel);
+        }
+    }
+    return failed;
+}
+
+// Print how a check went and pass its failures on
+static int report(const char *name, int failed) {
+    printf("%-15s %s\n", name, failed ? "FAILED" : "ok");
+    return failed;
+}
+
+int main(void)
+{
+    struct thread_pool *pool = create_thread_pool(3);   // More bands than rows on the smallest grids
+    int failed = 0;
+    failed += report("kernels", kernels());
+    failed += report("threads", threads(pool));
+    failed += report("temporal", temporal(pool));
+    failed += report("statistics", statistics(pool));
+    failed += report("activity", activity());
+    failed += report("hashlife/world", unbounded());
+    failed += report("ensemble", ensemble(pool));
+    failed += report("neighborhoods", neighborhoods(pool));
+    failed += report("random fill", random_fill(pool));
+    destroy_thread_pool(pool);
+    return failed ? 1 : 0;
+}
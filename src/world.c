@@ -0,0 +1,461 @@
+#include "world.h"
+#include "kernel.h"
+#include "pool.h"
+#include "activity.h"
+#include "random.h"
+#include "cycle.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WORLD_BUCKETS 1024      // Initial hash table size, doubled as chunks are added
+#define KEPT_FREE_CHUNKS 64     // Free chunks always kept, beyond that at most one per chunk in use
+
+// The 8 neighbors of a chunk, as chunk coordinate offsets
+static const int chunk_neighbors[8][2] = {
+    {-1, -1}, {0, -1}, {1, -1},
+    {-1, 0},           {1, 0},
+    {-1, 1},  {0, 1},  {1, 1}
+};
+
+static void *malloc_world(size_t size) {
+    void *data = calloc(1, size);
+    if (!data) {
+        fprintf(stderr, "Memory allocation failed for world!\n");
+        exit(1);
+    }
+    return data;
+}
+
+// Chunk coordinate of a cell coordinate, rounding towards negative infinity
+static int32_t chunk_coordinate(int64_t cell) {
+    return (int32_t)(cell >= 0 ? cell >> CHUNK_SHIFT : -((-cell - 1) >> CHUNK_SHIFT) - 1);
+}
+
+static size_t chunk_slot(const struct world *world, int32_t cx, int32_t cy) {
+    return (size_t)mix64(((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy) & (world->bucket_count - 1);
+}
+
+static struct chunk *find_chunk(const struct world *world, int32_t cx, int32_t cy) {
+    for (struct chunk *chunk = world->buckets[chunk_slot(world, cx, cy)]; chunk; chunk = chunk->next) {
+        if (chunk->cx == cx && chunk->cy == cy) return chunk;
+    }
+    return NULL;
+}
+
+// Double the hash table once it holds more chunks than buckets
+static void grow_buckets(struct world *world) {
+    size_t count = world->bucket_count * 2;
+    struct chunk **buckets = malloc_world(count * sizeof(struct chunk *));
+    struct chunk **old = world->buckets;
+    size_t old_count = world->bucket_count;
+
+    world->buckets = buckets;
+    world->bucket_count = count;
+    for (size_t i = 0; i < old_count; i++) {
+        struct chunk *chunk = old[i];
+        while (chunk) {
+            struct chunk *next = chunk->next;
+            size_t slot = chunk_slot(world, chunk->cx, chunk->cy);
+            chunk->next = buckets[slot];
+            buckets[slot] = chunk;
+            chunk = next;
+        }
+    }
+    free(old);
+}
+
+// Add an empty chunk at (cx, cy), reusing a free one when there is one
+static struct chunk *acquire_chunk(struct world *world, int32_t cx, int32_t cy) {
+    struct chunk *chunk = world->free_chunks;
+    if (chunk) {
+        world->free_chunks = chunk->next;
+        world->free_count--;
+        size_t bytes = chunk->grid.stride * (CHUNK_SIZE + 2);
+        memset(chunk->grid.grid1, 0, bytes);
+        memset(chunk->grid.grid2, 0, bytes);
+        chunk->grid.current = 0;
+    } else {
+        chunk = malloc_world(sizeof(struct chunk));
+        allocate_grid(&chunk->grid, CHUNK_SIZE, CHUNK_SIZE, world->states, NULL);
+        // The halo holds the neighbors' cells, or empty cells where there are
+        // none, so the kernels must not take it for a dead edge
+        chunk->grid.boundary = BOUNDARY_TORUS;
+    }
+    chunk->cx = cx;
+    chunk->cy = cy;
+    chunk->population = 0;
+    chunk->edges = 0;
+
+    if (world->chunk_count == world->chunk_capacity) {
+        world->chunk_capacity = world->chunk_capacity ? world->chunk_capacity * 2 : 64;
+        world->chunks = realloc(world->chunks, world->chunk_capacity * sizeof(struct chunk *));
+        if (!world->chunks) {
+            fprintf(stderr, "Memory allocation failed for world!\n");
+            exit(1);
+        }
+    }
+    chunk->index = world->chunk_count;
+    world->chunks[world->chunk_count++] = chunk;
+
+    if (world->chunk_count > world->bucket_count) {
+        grow_buckets(world);
+    }
+    size_t slot = chunk_slot(world, cx, cy);
+    chunk->next = world->buckets[slot];
+    world->buckets[slot] = chunk;
+    return chunk;
+}
+
+// Take a chunk out of the world and keep it for reuse, or free it if enough are kept
+static void release_chunk(struct world *world, struct chunk *chunk) {
+    struct chunk **link = &world->buckets[chunk_slot(world, chunk->cx, chunk->cy)];
+    while (*link != chunk) {
+        link = &(*link)->next;
+    }
+    *link = chunk->next;
+
+    struct chunk *last = world->chunks[--world->chunk_count];
+    world->chunks[chunk->index] = last;
+    last->index = chunk->index;
+
+    if (world->free_count < KEPT_FREE_CHUNKS || world->free_count < world->chunk_count) {
+        chunk->next = world->free_chunks;
+        world->free_chunks = chunk;
+        world->free_count++;
+    } else {
+        free_grid(&chunk->grid);
+        free(chunk);
+    }
+}
+
+// Neighbors a cell at (x, y) of a chunk borders on, as chunk->edges bits
+static int cell_edges(int x, int y) {
+    int edges = 0;
+    for (int n = 0; n < 8; n++) {
+        int dx = chunk_neighbors[n][0], dy = chunk_neighbors[n][1];
+        if ((dx == 0 || x == (dx < 0 ? 0 : CHUNK_SIZE - 1)) && (dy == 0 || y == (dy < 0 ? 0 : CHUNK_SIZE - 1))) {
+            edges |= 1 << n;
+        }
+    }
+    return edges;
+}
+
+// Count the live cells of a chunk and note which of its edges they touch
+static void measure_chunk(struct chunk *chunk, const uint8_t *cells) {
+    const struct grid *grid = &chunk->grid;
+    uint64_t population = 0;
+    int top = 0, bottom = 0, left = 0, right = 0;
+
+    for (int y = 0; y < CHUNK_SIZE; y++) {
+        const uint8_t *row = grid_row(grid, cells, y);
+        uint64_t live = 0;
+        if (grid->format == CELL_FORMAT_BITS) {
+            const uint64_t *words = (const uint64_t *)row;
+            uint64_t bits = (words[0] >> 1) | (words[1] << 63); // Cells 0 to 63, past the halo bit
+            live = (uint64_t)__builtin_popcountll(bits);
+            left |= (int)(bits & 1);
+            right |= (int)(bits >> 63);
+        } else {
+            for (int x = 1; x <= CHUNK_SIZE; x++) {
+                live += row[x] != 0;
+            }
+            left |= row[1] != 0;
+            right |= row[CHUNK_SIZE] != 0;
+        }
+        population += live;
+        if (y == 0) top = live != 0;
+        if (y == CHUNK_SIZE - 1) bottom = live != 0;
+    }
+
+    int edges = 0;
+    if (top) edges |= 1 << 1;
+    if (left) edges |= 1 << 3;
+    if (right) edges |= 1 << 4;
+    if (bottom) edges |= 1 << 6;
+    if (get_cell(grid, cells, 0, 0)) edges |= 1 << 0;
+    if (get_cell(grid, cells, CHUNK_SIZE - 1, 0)) edges |= 1 << 2;
+    if (get_cell(grid, cells, 0, CHUNK_SIZE - 1)) edges |= 1 << 5;
+    if (get_cell(grid, cells, CHUNK_SIZE - 1, CHUNK_SIZE - 1)) edges |= 1 << 7;
+    chunk->population = population;
+    chunk->edges = edges;
+}
+
+// Start an empty world for a rule, or return NULL if the rule would bring the
+// empty cells around the chunks to life (B0 and its multi-state versions)
+struct world *create_world(const struct rule *rule, int states) {
+    if (rule->states && rule->states != states) {
+        fprintf(stderr, "%s needs %d states, not %d\n", rule->name, rule->states, states);
+        return NULL;
+    }
+    if ((rule->kind == RULE_LIFE_LIKE && rule->table[0][0] != 0)
+        || (rule->kind == RULE_RANGES && rule->birth_min == 0)) {
+        fprintf(stderr, "Sparse worlds need a rule that keeps empty cells empty: %s\n", rule->name);
+        return NULL;
+    }
+    if (rule_reach(rule) > 1) {
+        fprintf(stderr, "Chunk halos only reach one cell, %s reaches %d\n", rule->name, rule_reach(rule));
+        return NULL;
+    }
+
+    struct world *world = malloc_world(sizeof(struct world));
+    world->rule = *rule;
+    world->states = states;
+    world->bucket_count = WORLD_BUCKETS;
+    world->buckets = malloc_world(world->bucket_count * sizeof(struct chunk *));
+    return world;
+}
+
+void destroy_world(struct world *world) {
+    if (!world) return;
+    while (world->chunk_count > 0) {
+        struct chunk *chunk = world->chunks[--world->chunk_count];
+        free_grid(&chunk->grid);
+        free(chunk);
+    }
+    while (world->free_chunks) {
+        struct chunk *chunk = world->free_chunks;
+        world->free_chunks = chunk->next;
+        free_grid(&chunk->grid);
+        free(chunk);
+    }
+    free(world->chunks);
+    free(world->buckets);
+    free(world);
+}
+
+int world_get_cell(const struct world *world, int64_t x, int64_t y) {
+    int32_t cx = chunk_coordinate(x), cy = chunk_coordinate(y);
+    const struct chunk *chunk = find_chunk(world, cx, cy);
+    if (!chunk) return 0;
+    return get_cell(&chunk->grid, current_cells(&chunk->grid),
+                    (int)(x - (int64_t)cx * CHUNK_SIZE), (int)(y - (int64_t)cy * CHUNK_SIZE));
+}
+
+// Set a cell of a chunk, keeping its population and edges up to date. The
+// edges only ever grow here; the next generation measures them again.
+static void set_chunk_cell(struct chunk *chunk, int x, int y, int state) {
+    uint8_t *cells = current_cells(&chunk->grid);
+    int old = get_cell(&chunk->grid, cells, x, y);
+    set_cell(&chunk->grid, cells, x, y, state);
+    chunk->population += (uint64_t)(state != 0) - (uint64_t)(old != 0);
+    if (state) {
+        chunk->edges |= cell_edges(x, y);
+    }
+}
+
+void world_set_cell(struct world *world, int64_t x, int64_t y, int state) {
+    int32_t cx = chunk_coordinate(x), cy = chunk_coordinate(y);
+    struct chunk *chunk = find_chunk(world, cx, cy);
+    if (!chunk) {
+        if (state == 0) return;
+        chunk = acquire_chunk(world, cx, cy);
+    }
+    set_chunk_cell(chunk, (int)(x - (int64_t)cx * CHUNK_SIZE), (int)(y - (int64_t)cy * CHUNK_SIZE), state);
+}
+
+// Copy the grid's current generation into the world with its top-left cell
+// at (x0, y0). Chunks are only created where the grid has live cells.
+void world_import(struct world *world, struct grid *grid, int64_t x0, int64_t y0) {
+    const uint8_t *cells = current_cells(grid);
+    struct chunk *chunk = NULL;
+    for (int y = 0; y < grid->height; y++) {
+        for (int x = 0; x < grid->width; x++) {
+            int state = get_cell(grid, cells, x, y);
+            int32_t cx = chunk_coordinate(x0 + x), cy = chunk_coordinate(y0 + y);
+            if (!chunk || chunk->cx != cx || chunk->cy != cy) {
+                chunk = find_chunk(world, cx, cy);
+                if (!chunk && state == 0) continue;
+                if (!chunk) chunk = acquire_chunk(world, cx, cy);
+            }
+            set_chunk_cell(chunk, (int)(x0 + x - (int64_t)cx * CHUNK_SIZE), (int)(y0 + y - (int64_t)cy * CHUNK_SIZE),
+                           state);
+        }
+    }
+    world->generation = grid->generation;
+}
+
+// Copy the world window starting at (x0, y0) into the grid's current
+// generation. Live cells outside the window are not represented.
+void world_export(const struct world *world, struct grid *grid, int64_t x0, int64_t y0) {
+    uint8_t *cells = current_cells(grid);
+    for (int y = 0; y < grid->height; y++) {
+        for (int x = 0; x < grid->width; x++) {
+            set_cell(grid, cells, x, y, 0);
+        }
+    }
+    for (size_t i = 0; i < world->chunk_count; i++) {
+        const struct chunk *chunk = world->chunks[i];
+        const uint8_t *chunk_cells = current_cells(&chunk->grid);
+        int64_t left = (int64_t)chunk->cx * CHUNK_SIZE - x0, top = (int64_t)chunk->cy * CHUNK_SIZE - y0;
+        if (left >= grid->width || top >= grid->height || left + CHUNK_SIZE <= 0 || top + CHUNK_SIZE <= 0) {
+            continue;
+        }
+        for (int y = 0; y < CHUNK_SIZE; y++) {
+            if (top + y < 0 || top + y >= grid->height) continue;
+            for (int x = 0; x < CHUNK_SIZE; x++) {
+                if (left + x < 0 || left + x >= grid->width) continue;
+                set_cell(grid, cells, (int)(left + x), (int)(top + y), get_cell(&chunk->grid, chunk_cells, x, y));
+            }
+        }
+    }
+    grid->generation = world->generation;
+    mark_all_changed(grid);
+    rehash_grid(grid);
+    recount_grid_stats(grid);
+}
+
+// Copy the current generation of a chunk into cells, a buffer laid out like
+// its own, and fill the halo there from the current generation of its
+// neighbors; missing neighbors are empty. The chunk's own buffers are only
+// read, as the halo shares words with the edge cells other threads read.
+static void fill_chunk_halo(const struct world *world, const struct chunk *chunk, uint8_t *cells) {
+    const struct grid *grid = &chunk->grid;
+    memcpy(grid_row(grid, cells, 0), grid_row(grid, current_cells(grid), 0), grid->stride * CHUNK_SIZE);
+
+    const struct chunk *around[8];
+    for (int n = 0; n < 8; n++) {
+        around[n] = find_chunk(world, chunk->cx + chunk_neighbors[n][0], chunk->cy + chunk_neighbors[n][1]);
+    }
+
+    // Whole rows above and below, with the corners set afterwards
+    if (around[1]) {
+        memcpy(grid_row(grid, cells, -1), grid_row(&around[1]->grid, current_cells(&around[1]->grid), CHUNK_SIZE - 1),
+               grid->stride);
+    } else {
+        memset(grid_row(grid, cells, -1), 0, grid->stride);
+    }
+    if (around[6]) {
+        memcpy(grid_row(grid, cells, CHUNK_SIZE), grid_row(&around[6]->grid, current_cells(&around[6]->grid), 0),
+               grid->stride);
+    } else {
+        memset(grid_row(grid, cells, CHUNK_SIZE), 0, grid->stride);
+    }
+
+    const struct chunk *left = around[3], *right = around[4];
+    for (int y = 0; y < CHUNK_SIZE; y++) {
+        set_cell(grid, cells, -1, y, left ? get_cell(&left->grid, current_cells(&left->grid), CHUNK_SIZE - 1, y) : 0);
+        set_cell(grid, cells, CHUNK_SIZE, y, right ? get_cell(&right->grid, current_cells(&right->grid), 0, y) : 0);
+    }
+
+    static const int corners[4][5] = {
+        // neighbor, halo x, halo y, neighbor x, neighbor y
+        {0, -1, -1, CHUNK_SIZE - 1, CHUNK_SIZE - 1},
+        {2, CHUNK_SIZE, -1, 0, CHUNK_SIZE - 1},
+        {5, -1, CHUNK_SIZE, CHUNK_SIZE - 1, 0},
+        {7, CHUNK_SIZE, CHUNK_SIZE, 0, 0}
+    };
+    for (int c = 0; c < 4; c++) {
+        const struct chunk *corner = around[corners[c][0]];
+        int state = corner ? get_cell(&corner->grid, current_cells(&corner->grid), corners[c][3], corners[c][4]) : 0;
+        set_cell(grid, cells, corners[c][1], corners[c][2], state);
+    }
+}
+
+// Add the neighbors the live cells could spread into during the next generation
+static void expand_world(struct world *world) {
+    size_t count = world->chunk_count;
+    for (size_t i = 0; i < count; i++) {
+        struct chunk *chunk = world->chunks[i];
+        for (int n = 0; n < 8; n++) {
+            if (!(chunk->edges & (1 << n))) continue;
+            int32_t cx = chunk->cx + chunk_neighbors[n][0], cy = chunk->cy + chunk_neighbors[n][1];
+            if (!find_chunk(world, cx, cy)) {
+                acquire_chunk(world, cx, cy);
+            }
+        }
+    }
+}
+
+struct world_job {
+    struct world *world;
+    step_kernel kernel;
+    uint8_t **scratch;      // One chunk buffer with its halo per thread
+};
+
+// Step a contiguous share of the chunks. Every chunk only writes its next
+// generation, and only reads the current generation of itself and others.
+static void step_chunks(void *arg, int thread, int threads) {
+    struct world_job *job = arg;
+    struct world *world = job->world;
+    uint8_t *cells = job->scratch[thread];
+    size_t first = world->chunk_count * (size_t)thread / (size_t)threads;
+    size_t last = world->chunk_count * (size_t)(thread + 1) / (size_t)threads;
+    for (size_t i = first; i < last; i++) {
+        struct chunk *chunk = world->chunks[i];
+        uint8_t *next = next_cells(&chunk->grid);
+        fill_chunk_halo(world, chunk, cells);
+        job->kernel(&chunk->grid, &world->rule, cells, next, 0, CHUNK_SIZE, 0, CHUNK_SIZE);
+        measure_chunk(chunk, next);
+    }
+}
+
+// Advance the world by one generation, the same as update_grid_with_rule on
+// a grid large enough to hold every live cell
+void step_world(struct world *world) {
+    expand_world(world);
+    if (world->chunk_count > 0) {
+        const struct grid *layout = &world->chunks[0]->grid;
+        int threads = (world->pool && world->pool->threads > 1) ? world->pool->threads : 1;
+        size_t bytes = layout->stride * (CHUNK_SIZE + 2);
+        struct world_job job = {world, select_kernel(layout, &world->rule), malloc_world(threads * sizeof(uint8_t *))};
+        for (int i = 0; i < threads; i++) {
+            job.scratch[i] = mallocgrid(bytes);
+        }
+        if (threads > 1) {
+            run_on_pool(world->pool, step_chunks, &job);
+        } else {
+            step_chunks(&job, 0, 1);
+        }
+        for (int i = 0; i < threads; i++) {
+            free_cells(job.scratch[i], bytes);
+        }
+        free(job.scratch);
+    }
+
+    // Backwards, since releasing a chunk moves the last one into its place
+    for (size_t i = world->chunk_count; i-- > 0; ) {
+        struct chunk *chunk = world->chunks[i];
+        chunk->grid.current = 1 - chunk->grid.current;
+        if (chunk->population == 0) {
+            release_chunk(world, chunk);
+        }
+    }
+    world->generation++;
+}
+
+void advance_world(struct world *world, uint64_t generations) {
+    for (uint64_t i = 0; i < generations; i++) {
+        step_world(world);
+    }
+}
+
+uint64_t world_population(const struct world *world) {
+    uint64_t population = 0;
+    for (size_t i = 0; i < world->chunk_count; i++) {
+        population += world->chunks[i]->population;
+    }
+    return population;
+}
+
+// Bounding box [x0, x1) x [y0, y1) of the chunks in use, 0 if there are none
+int world_bounds(const struct world *world, int64_t *x0, int64_t *y0, int64_t *x1, int64_t *y1) {
+    if (world->chunk_count == 0) {
+        *x0 = *y0 = *x1 = *y1 = 0;
+        return 0;
+    }
+    int32_t min_x = INT32_MAX, min_y = INT32_MAX, max_x = INT32_MIN, max_y = INT32_MIN;
+    for (size_t i = 0; i < world->chunk_count; i++) {
+        const struct chunk *chunk = world->chunks[i];
+        if (chunk->cx < min_x) min_x = chunk->cx;
+        if (chunk->cy < min_y) min_y = chunk->cy;
+        if (chunk->cx > max_x) max_x = chunk->cx;
+        if (chunk->cy > max_y) max_y = chunk->cy;
+    }
+    *x0 = (int64_t)min_x * CHUNK_SIZE;
+    *y0 = (int64_t)min_y * CHUNK_SIZE;
+    *x1 = ((int64_t)max_x + 1) * CHUNK_SIZE;
+    *y1 = ((int64_t)max_y + 1) * CHUNK_SIZE;
+    return 1;
+}
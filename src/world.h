@@ -0,0 +1,59 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include "grid.h"
+#include "rule.h"
+
+#define CHUNK_SHIFT 6
+#define CHUNK_SIZE (1 << CHUNK_SHIFT)   // Cells per chunk side, one word of a bit grid
+
+// An unbounded world made of CHUNK_SIZE x CHUNK_SIZE chunks kept in a hash
+// table by chunk coordinate. Everything outside the chunks is state 0, so
+// only rules that leave an empty neighborhood empty can run this way.
+//
+// Each chunk is a small struct grid stepped by the same kernels as a dense
+// grid; its halo is filled from the neighboring chunks instead of a boundary
+// mode. Before a generation, chunks with live cells on an edge get the
+// neighbors on that side, and after it chunks that went empty are handed
+// back to the free list, so memory follows the live cells rather than
+// their bounding box.
+struct chunk {
+    int32_t cx;                 // Chunk coordinates, the chunk starts at cell (cx, cy) * CHUNK_SIZE
+    int32_t cy;
+    struct grid grid;           // CHUNK_SIZE x CHUNK_SIZE cells with a halo
+    struct chunk *next;         // Hash chain, or the free list
+    size_t index;               // Position in world->chunks
+    uint64_t population;        // Cells not in state 0
+    int edges;                  // Neighbors the live cells touch, bit n for chunk_neighbors[n]
+};
+
+struct world {
+    struct rule rule;
+    int states;
+    struct chunk **buckets;
+    size_t bucket_count;
+    struct chunk **chunks;      // Every chunk in use, in no particular order
+    size_t chunk_count;
+    size_t chunk_capacity;
+    struct chunk *free_chunks;  // Chunks kept for reuse, with their cell buffers
+    size_t free_count;
+    struct thread_pool *pool;   // Steps chunks in parallel when set
+    uint64_t generation;
+};
+
+struct world *create_world(const struct rule *rule, int states);
+void destroy_world(struct world *world);
+
+int world_get_cell(const struct world *world, int64_t x, int64_t y);
+void world_set_cell(struct world *world, int64_t x, int64_t y, int state);
+
+void world_import(struct world *world, struct grid *grid, int64_t x0, int64_t y0);
+void world_export(const struct world *world, struct grid *grid, int64_t x0, int64_t y0);
+
+void step_world(struct world *world);
+void advance_world(struct world *world, uint64_t generations);
+
+uint64_t world_population(const struct world *world);
+int world_bounds(const struct world *world, int64_t *x0, int64_t *y0, int64_t *x1, int64_t *y1);
+
+#endif